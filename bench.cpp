@@ -0,0 +1,464 @@
+#include <array>
+#include <cstring>
+#include <random>
+#include <string>
+
+#include <bench.h>
+#include <fixed_neural_net.h>
+#include <genetic_algorithm.h>
+#include <neural_net.h>
+#include <simulation.h>
+#include <vector_env.h>
+
+constexpr uint32_t num_inputs = Brain_neural_net::num_inputs;
+constexpr uint32_t num_hidden = Brain_neural_net::num_hidden;
+constexpr uint32_t num_outputs = Brain_neural_net::num_outputs;
+
+void bench_forward(Bench_runner& runner, uint32_t num_genomes) {
+	auto rng = std::mt19937(1234);
+	auto dist = std::uniform_real_distribution<float>(-1.0f, 1.0f);
+	auto neural_net = Neural_net(num_inputs, num_hidden, num_outputs);
+	auto num_weights = num_inputs * num_hidden + num_hidden * num_outputs;
+	auto genomes = std::vector<std::vector<float>>(num_genomes, std::vector<float>(num_weights));
+	auto inputs = std::vector<float>(static_cast<size_t>(num_inputs) * num_genomes);
+	auto batch_weights = Batch_weights();
+
+	for (auto& genome : genomes) {
+		for (auto& weight : genome) {
+			weight = dist(rng);
+		}
+	}
+
+	for (auto& input : inputs) {
+		input = dist(rng);
+	}
+
+	neural_net.init_batch_weights(batch_weights, num_genomes);
+
+	for (uint32_t idx_genome = 0; idx_genome < num_genomes; idx_genome++) {
+		neural_net.set_batch_genome(batch_weights, idx_genome, genomes[idx_genome]);
+	}
+
+	auto suffix = " x" + std::to_string(num_genomes);
+	auto actions_reference = std::vector<uint32_t>(num_genomes);
+	auto actions = std::vector<uint32_t>(num_genomes);
+	auto genome_inputs = std::vector<float>(num_inputs);
+
+	auto forward_per_genome = [&]() {
+		for (uint32_t idx_genome = 0; idx_genome < num_genomes; idx_genome++) {
+			for (uint32_t idx_input = 0; idx_input < num_inputs; idx_input++) {
+				genome_inputs[idx_input] = inputs[static_cast<size_t>(idx_input) * num_genomes + idx_genome];
+			}
+			neural_net.forward(genome_inputs, genomes[idx_genome], actions_reference[idx_genome]);
+		}
+		};
+
+	// Also outside the runner, which skips filtered out benchmarks
+	forward_per_genome();
+	runner.run("forward/per_genome" + suffix, num_genomes, forward_per_genome);
+
+	// The same topology compiled in, against the runtime-sized network above
+	auto fixed_neural_net = Brain_neural_net();
+	auto report_diverged = [&](const char* name) {
+		auto num_diverged = 0;
+
+		for (uint32_t idx_genome = 0; idx_genome < num_genomes; idx_genome++) {
+			if (actions[idx_genome] != actions_reference[idx_genome]) {
+				num_diverged++;
+			}
+		}
+
+		if (num_diverged > 0) {
+			std::cout << "  " << num_diverged << " of " << num_genomes << " actions of " << name << " differ from the scalar reference\n";
+		}
+		};
+
+	auto ran = runner.run("fixed_forward/per_genome" + suffix, num_genomes, [&]() {
+		for (uint32_t idx_genome = 0; idx_genome < num_genomes; idx_genome++) {
+			for (uint32_t idx_input = 0; idx_input < num_inputs; idx_input++) {
+				genome_inputs[idx_input] = inputs[static_cast<size_t>(idx_input) * num_genomes + idx_genome];
+			}
+			actions[idx_genome] = fixed_neural_net.forward(std::span<const float, num_inputs>(genome_inputs.data(), num_inputs),
+				std::span<const float, Brain_neural_net::num_weights>(genomes[idx_genome].data(), Brain_neural_net::num_weights));
+		}
+		});
+
+	if (ran) {
+		report_diverged("fixed_forward/per_genome");
+	}
+
+	ran = runner.run("fixed_forward_batch" + suffix, num_genomes, [&]() {
+		fixed_neural_net.forward_batch(inputs.data(), num_genomes, batch_weights, 0, num_genomes, actions.data());
+		});
+
+	if (ran) {
+		report_diverged("fixed_forward_batch");
+	}
+
+	auto max_simd_level = detect_simd_level();
+
+	for (auto simd_level : { Simd_level::Scalar, Simd_level::Sse42, Simd_level::Avx2, Simd_level::Avx512 }) {
+		if (static_cast<int>(simd_level) > static_cast<int>(max_simd_level)) {
+			break;
+		}
+
+		neural_net.set_simd_level(simd_level);
+		ran = runner.run(std::string("forward_batch/") + simd_level_name(simd_level) + suffix, num_genomes, [&]() {
+			neural_net.forward_batch(inputs.data(), num_genomes, batch_weights, 0, num_genomes, actions.data());
+			});
+
+		if (ran) {
+			report_diverged((std::string("forward_batch/") + simd_level_name(simd_level)).c_str());
+		}
+	}
+}
+
+// forward_batch at the best SIMD level with weights stored in each Weight_precision, and how many
+//	actions the reduced precisions change against fp32 on the same kernel
+void bench_weight_precision(Bench_runner& runner, uint32_t num_genomes) {
+	auto rng = std::mt19937(1234);
+	auto dist = std::uniform_real_distribution<float>(-1.0f, 1.0f);
+	auto neural_net = Neural_net(num_inputs, num_hidden, num_outputs);
+	auto genome = std::vector<float>(Brain_neural_net::num_weights);
+	auto inputs = std::vector<float>(static_cast<size_t>(num_inputs) * num_genomes);
+	auto batch_weights = std::array<Batch_weights, 3>();
+	auto precisions = std::array{ Weight_precision::Fp32, Weight_precision::Fp16, Weight_precision::Int8 };
+	auto suffix = " x" + std::to_string(num_genomes);
+	auto actions_fp32 = std::vector<uint32_t>(num_genomes);
+	auto actions = std::vector<uint32_t>(num_genomes);
+
+	for (auto& input : inputs) {
+		input = dist(rng);
+	}
+
+	for (size_t idx_precision = 0; idx_precision < precisions.size(); idx_precision++) {
+		neural_net.init_batch_weights(batch_weights[idx_precision], num_genomes, precisions[idx_precision]);
+	}
+
+	for (uint32_t idx_genome = 0; idx_genome < num_genomes; idx_genome++) {
+		for (auto& weight : genome) {
+			weight = dist(rng);
+		}
+
+		for (auto& weights : batch_weights) {
+			neural_net.set_batch_genome(weights, idx_genome, genome);
+		}
+	}
+
+	neural_net.forward_batch(inputs.data(), num_genomes, batch_weights[0], 0, num_genomes, actions_fp32.data());
+
+	for (size_t idx_precision = 0; idx_precision < precisions.size(); idx_precision++) {
+		auto name = std::string("weights/") + weight_precision_name(precisions[idx_precision]) + suffix;
+
+		auto ran = runner.run(name, num_genomes, [&]() {
+			neural_net.forward_batch(inputs.data(), num_genomes, batch_weights[idx_precision], 0, num_genomes, actions.data());
+			});
+
+		if (!ran || (idx_precision == 0)) {
+			continue;
+		}
+
+		auto num_diverged = 0;
+
+		for (uint32_t idx_genome = 0; idx_genome < num_genomes; idx_genome++) {
+			num_diverged += (actions[idx_genome] != actions_fp32[idx_genome]) ? 1 : 0;
+		}
+
+		std::cout << "  " << num_diverged << " of " << num_genomes << " actions (" << 100.0 * num_diverged / num_genomes
+			<< "%) differ from fp32\n";
+	}
+}
+
+// Player-vs-barrel overlap tests as done at the end of physics(), against a full buffer of barrels
+void bench_barrel_collisions(Bench_runner& runner, uint32_t num_players) {
+	auto rng = std::mt19937(1234);
+	auto dist_x = std::uniform_int_distribution<int>(-112, 112);
+	auto dist_y = std::uniform_int_distribution<int>(-120, 80);
+	auto barrels = Entity_store();
+	auto players = Player_store();
+	auto broad_phase = Barrel_broad_phase();
+	auto suffix = " x" + std::to_string(num_players);
+	auto num_hits_reference = 0;
+	auto num_hits = 0;
+
+	barrels.width = barrel_width;
+	barrels.height = barrel_height;
+	barrels.resize(50);
+
+	for (size_t idx_barrel = 0; idx_barrel < barrels.size(); idx_barrel++) {
+		barrels.offset_x[idx_barrel] = dist_x(rng);
+		barrels.offset_y[idx_barrel] = dist_y(rng);
+	}
+
+	players.resize(num_players);
+
+	for (uint32_t idx_player = 0; idx_player < num_players; idx_player++) {
+		players.offset_x[idx_player] = dist_x(rng);
+		players.offset_y[idx_player] = dist_y(rng);
+	}
+
+	runner.run("barrel_collisions/all_pairs" + suffix, num_players, [&]() {
+		num_hits_reference = 0;
+
+		for (uint32_t idx_player = 0; idx_player < num_players; idx_player++) {
+			auto x = players.offset_x[idx_player];
+			auto y = players.offset_y[idx_player];
+
+			for (size_t idx_barrel = 0; idx_barrel < barrels.size(); idx_barrel++) {
+				auto ok1 = x <= (barrels.offset_x[idx_barrel] + barrels.width / 2);
+				auto ok2 = x >= (barrels.offset_x[idx_barrel] - barrels.width / 2);
+				auto ok3 = y <= (barrels.offset_y[idx_barrel] + barrels.height / 2);
+				auto ok4 = y >= (barrels.offset_y[idx_barrel] - barrels.height / 2);
+				if (ok1 && ok2 && ok3 && ok4) {
+					num_hits_reference++;
+					break;
+				}
+			}
+		}
+		});
+
+	runner.run("barrel_collisions/broad_phase" + suffix, num_players, [&]() {
+		num_hits = 0;
+		broad_phase.build(barrels);
+
+		for (uint32_t idx_player = 0; idx_player < num_players; idx_player++) {
+			if (broad_phase.overlaps(players.offset_x[idx_player], players.offset_y[idx_player])) {
+				num_hits++;
+			}
+		}
+		});
+
+	if (num_hits != num_hits_reference) {
+		std::cout << "  broad phase found " << num_hits << " hits, all pairs " << num_hits_reference << "\n";
+	}
+}
+
+// One Vector_env step of num_envs games with num_agents random-acting agents each, on the calling thread
+void bench_vector_env(Bench_runner& runner, const Level& level, uint32_t num_envs, uint32_t num_agents) {
+	auto rng = std::mt19937(1234);
+	auto dist = std::uniform_int_distribution<uint32_t>(0, 2);
+	auto num_agents_before = settings.game.num_agents;
+
+	settings.game.num_agents = static_cast<int>(num_agents);
+
+	auto vector_env = Vector_env(num_envs, 1234, nullptr);
+	auto actions = std::vector<uint32_t>(static_cast<size_t>(num_envs) * num_agents);
+
+	for (auto& action : actions) {
+		action = dist(rng);
+	}
+
+	vector_env.reset(level);
+	runner.run("vector_env/step " + std::to_string(num_envs) + "x" + std::to_string(num_agents), actions.size(), [&]() {
+		vector_env.step(level, actions);
+		});
+
+	settings.game.num_agents = num_agents_before;
+}
+
+// Breeding a population of num_genomes from random fitness values, and its two per-child building blocks
+void bench_genetic_algorithm(Bench_runner& runner, uint32_t num_genomes) {
+	auto rng = std::mt19937(1234);
+	auto dist = std::uniform_real_distribution<float>(0.0f, 1000.0f);
+	auto num_weights = num_inputs * num_hidden + num_hidden * num_outputs;
+	auto genetic_algorithm = Genetic_algorithm(num_genomes, num_weights, Random(1234));
+	auto& population = genetic_algorithm.population;
+	auto suffix = " x" + std::to_string(num_genomes);
+
+	// Every run starts from a fresh draw, as in a generation
+	runner.run("genetic_algorithm/new_generation" + suffix, num_genomes, [&]() {
+		genetic_algorithm.new_generation();
+		}, [&]() {
+			for (auto& genome : population) {
+				genome.fitness = dist(rng);
+			}
+		});
+
+	runner.run("genetic_algorithm/crossover" + suffix, num_genomes, [&]() {
+		for (uint32_t idx_genome = 2; idx_genome < num_genomes; idx_genome++) {
+			genetic_algorithm.crossover(population[0], population[1], population[idx_genome]);
+		}
+		});
+
+	runner.run("genetic_algorithm/mutate" + suffix, num_genomes, [&]() {
+		for (auto& genome : population) {
+			genetic_algorithm.mutate(genome);
+		}
+		});
+}
+
+// Picking every parent of a generation of num_genomes with each Selection, next to the full sort of the
+//	genome views that selection used to be. Genomes of one weight, as selection never reads weights.
+void bench_selection(Bench_runner& runner, uint32_t num_genomes) {
+	auto rng = std::mt19937(1234);
+	auto dist = std::uniform_real_distribution<float>(0.0f, 1000.0f);
+	auto genetic_algorithm = Genetic_algorithm(num_genomes, 1, Random(1234));
+	auto& population = genetic_algorithm.population;
+	auto suffix = " x" + std::to_string(num_genomes);
+	auto draw_fitness = [&]() {
+		for (auto& genome : population) {
+			genome.fitness = dist(rng);
+		}
+		};
+
+	runner.run("selection/sort_views" + suffix, num_genomes, [&]() {
+		std::sort(population.begin(), population.end(), [](const Genetic_algorithm::Genome& genome1, const Genetic_algorithm::Genome& genome2) {
+			return genome1.fitness > genome2.fitness;
+			});
+		}, draw_fitness);
+
+	for (auto selection : { Selection::Truncation, Selection::Tournament, Selection::Rank, Selection::Stochastic_universal }) {
+		genetic_algorithm.selection = selection;
+		runner.run(std::string("selection/") + selection_name(selection) + suffix, num_genomes, [&]() {
+			genetic_algorithm.select_parents();
+			}, draw_fitness);
+	}
+}
+
+// Players and barrels scattered over the level, for benchmarks of a single step
+void scatter_entities(Sim_state& sim, uint32_t num_players, uint32_t num_barrels) {
+	auto rng = std::mt19937(1234);
+	auto dist_x = std::uniform_int_distribution<int>(-112, 112);
+	auto dist_y = std::uniform_int_distribution<int>(-120, 100);
+
+	init_players(sim.players, num_players, false, player_width, player_height);
+
+	for (uint32_t idx_player = 0; idx_player < num_players; idx_player++) {
+		sim.players.offset_x[idx_player] = dist_x(rng);
+		sim.players.offset_y[idx_player] = dist_y(rng);
+	}
+
+	sim.barrel_buffer = Barrel_buffer(num_barrels, barrel_width, barrel_height);
+
+	for (uint32_t idx_barrel = 0; idx_barrel < num_barrels; idx_barrel++) {
+		auto barrel = new_barrel((idx_barrel % 2) == 0);
+		barrel.offset_x = dist_x(rng);
+		barrel.offset_y = dist_y(rng);
+		sim.barrel_buffer.add_element(barrel);
+	}
+}
+
+// One physics() step on the calling thread. Players fall and die as steps go by, so every run starts
+//	from the same scattered state.
+void bench_physics(Bench_runner& runner, const Level& level, uint32_t num_players, uint32_t num_barrels) {
+	auto sim = Sim_state();
+	auto players = Player_store();
+	auto barrel_buffer = Barrel_buffer(num_barrels, barrel_width, barrel_height);
+
+	scatter_entities(sim, num_players, num_barrels);
+	players = sim.players;
+	barrel_buffer = sim.barrel_buffer;
+
+	runner.run("physics " + std::to_string(num_players) + "p/" + std::to_string(num_barrels) + "b", num_players, [&]() {
+		physics(sim, level);
+		}, [&]() {
+			sim.players = players;
+			sim.barrel_buffer = barrel_buffer;
+		});
+}
+
+// Sensor readings for every agent, the observation half of begin_step, on the calling thread
+void bench_observe(Bench_runner& runner, const Level& level, uint32_t num_players) {
+	auto sim = Sim_state();
+
+	scatter_entities(sim, num_players, 50);
+	sim.num_physics_steps = 1;
+
+	runner.run("observe x" + std::to_string(num_players), num_players, [&]() {
+		begin_step(sim, level);
+		});
+}
+
+// A whole generation from a fresh population: playing it until every agent is dead, then breeding the next
+void bench_generation(Bench_runner& runner, const Level& level, uint32_t num_agents) {
+	auto num_agents_before = settings.game.num_agents;
+	auto sim = Sim_state();
+
+	settings.game.num_agents = static_cast<int>(num_agents);
+
+	runner.run("generation x" + std::to_string(num_agents), num_agents, [&]() {
+		run_generation(sim, level);
+		next_generation(sim);
+		}, [&]() {
+			init_sim_state(sim, 1234, nullptr);
+			sim.verbose = false;
+		});
+
+	settings.game.num_agents = num_agents_before;
+}
+
+int main(int argc, char** argv) {
+	auto runner = Bench_runner(5, 51);
+	auto path_json = std::string();
+	auto build = std::string();
+
+	for (auto idx_arg = 1; idx_arg < argc; idx_arg++) {
+		auto has_value = idx_arg + 1 < argc;
+
+		if ((std::strcmp(argv[idx_arg], "--json") == 0) && has_value) {
+			path_json = argv[++idx_arg];
+		}
+		else if ((std::strcmp(argv[idx_arg], "--build") == 0) && has_value) {
+			build = argv[++idx_arg];
+		}
+		else if ((std::strcmp(argv[idx_arg], "--filter") == 0) && has_value) {
+			runner.set_filter(argv[++idx_arg]);
+		}
+		else {
+			std::cerr << "Usage: " << argv[0] << " [--json PATH] [--build NAME] [--filter SUBSTRING]\n";
+			return 1;
+		}
+	}
+
+	std::cout << "Detected SIMD level: " << simd_level_name(detect_simd_level()) << "\n";
+
+	for (auto num_genomes : { 500u, 5000u, 50000u }) {
+		bench_forward(runner, num_genomes);
+	}
+
+	for (auto num_genomes : { 500u, 5000u, 50000u }) {
+		bench_weight_precision(runner, num_genomes);
+	}
+
+	for (auto num_genomes : { 500u, 5000u }) {
+		bench_genetic_algorithm(runner, num_genomes);
+	}
+
+	for (auto num_genomes : { 5000u, 100000u, 1000000u }) {
+		bench_selection(runner, num_genomes);
+	}
+
+	for (auto num_players : { 500u, 5000u, 50000u }) {
+		bench_barrel_collisions(runner, num_players);
+	}
+
+	auto level = Level(generate_level(settings.gui.num_squares_x), player_width / 2);
+
+	for (auto num_players : { 500u, 5000u, 50000u }) {
+		for (auto num_barrels : { 10u, 50u }) {
+			bench_physics(runner, level, num_players, num_barrels);
+		}
+	}
+
+	for (auto num_players : { 500u, 5000u, 50000u }) {
+		bench_observe(runner, level, num_players);
+	}
+
+	for (auto num_envs : { 1u, 16u, 256u }) {
+		bench_vector_env(runner, level, num_envs, 64);
+	}
+
+	// A generation takes thousands of steps, so fewer repetitions
+	runner.set_reps(1, 7);
+
+	for (auto num_agents : { 500u, 2000u }) {
+		bench_generation(runner, level, num_agents);
+	}
+
+	if (!path_json.empty() && !runner.write_json(path_json, build)) {
+		std::cerr << "Could not write " << path_json << "\n";
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Minimal in-tree benchmark harness: warmup runs, then timed repetitions of the whole function
+class Bench_runner {
+public:
+	struct Result {
+		std::string name = {};
+		uint64_t items_per_rep = {};
+		uint32_t num_reps = {};
+		double median_ns = {};
+		double p99_ns = {};
+		double min_ns = {};
+	};
+
+	Bench_runner(uint32_t num_warmup, uint32_t num_reps) : num_warmup(num_warmup), num_reps(num_reps) {}
+
+	// Repetition counts for the benchmarks run after this, for ones too slow for the defaults
+	void set_reps(uint32_t num_warmup_new, uint32_t num_reps_new) {
+		num_warmup = num_warmup_new;
+		num_reps = num_reps_new;
+	}
+
+	// Only benchmarks whose name contains filter are run
+	void set_filter(const std::string& filter_new) {
+		filter = filter_new;
+	}
+
+	// setup, if set, runs untimed before every warmup and timed run, for benchmarks that change their input.
+	//	False if the filter skipped the benchmark.
+	bool run(const std::string& name, uint64_t items_per_rep, const std::function<void()>& fn, const std::function<void()>& setup = {}) {
+		if (name.find(filter) == std::string::npos) {
+			return false;
+		}
+
+		auto times_ns = std::vector<double>(num_reps);
+
+		for (uint32_t idx_warmup = 0; idx_warmup < num_warmup; idx_warmup++) {
+			if (setup) {
+				setup();
+			}
+			fn();
+		}
+
+		for (auto& time_ns : times_ns) {
+			if (setup) {
+				setup();
+			}
+			auto time_start = std::chrono::steady_clock::now();
+			fn();
+			time_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - time_start).count();
+		}
+
+		std::sort(times_ns.begin(), times_ns.end());
+
+		// Nearest-rank percentile, so with fewer than 100 repetitions p99 is the slowest one
+		auto idx_p99 = static_cast<size_t>(std::ceil(0.99 * static_cast<double>(times_ns.size()))) - 1;
+		auto result = Result{ name, items_per_rep, num_reps, times_ns[times_ns.size() / 2], times_ns[idx_p99], times_ns.front() };
+
+		std::cout << std::left << std::setw(48) << result.name << std::right
+			<< std::setw(14) << std::fixed << std::setprecision(1) << result.median_ns << " ns"
+			<< std::setw(14) << std::setprecision(1) << result.p99_ns << " ns p99"
+			<< std::setw(14) << std::setprecision(2) << result.median_ns / result.items_per_rep << " ns/item\n";
+
+		results.push_back(result);
+
+		return true;
+	}
+
+	// All results so far as one JSON object, tagged with build so runs of different builds can be diffed
+	bool write_json(const std::string& path, const std::string& build) const {
+		auto file = std::ofstream(path, std::ios::trunc);
+
+		file << "{\n  \"build\": \"" << build << "\",\n  \"benchmarks\": [\n" << std::fixed << std::setprecision(1);
+
+		for (size_t idx_result = 0; idx_result < results.size(); idx_result++) {
+			auto& result = results[idx_result];
+
+			file << "    { \"name\": \"" << result.name << "\", \"items_per_rep\": " << result.items_per_rep
+				<< ", \"reps\": " << result.num_reps << ", \"median_ns\": " << result.median_ns
+				<< ", \"p99_ns\": " << result.p99_ns << ", \"min_ns\": " << result.min_ns
+				<< ", \"median_ns_per_item\": " << std::setprecision(3) << result.median_ns / result.items_per_rep << std::setprecision(1)
+				<< " }" << ((idx_result + 1 < results.size()) ? "," : "") << "\n";
+		}
+
+		file << "  ]\n}\n";
+
+		return file.good();
+	}
+
+	std::vector<Result> results = {};
+private:
+	uint32_t num_warmup = {};
+	uint32_t num_reps = {};
+	std::string filter = {};
+};
@@ -0,0 +1,237 @@
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <type_traits>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <checkpoint.h>
+
+static_assert(std::is_trivially_copyable_v<Checkpoint_header>);
+
+namespace {
+	size_t align_up(size_t offset) {
+		return (offset + checkpoint_alignment - 1) / checkpoint_alignment * checkpoint_alignment;
+	}
+
+	// Read-only view of a whole file, unmapped when it goes out of scope
+	class Mapped_file {
+	public:
+		Mapped_file(const std::string& path) {
+#ifdef _WIN32
+			file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+			auto file_size = LARGE_INTEGER();
+
+			if ((file == INVALID_HANDLE_VALUE) || !GetFileSizeEx(file, &file_size) || (file_size.QuadPart == 0)) {
+				return;
+			}
+
+			mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+			if (!mapping) {
+				return;
+			}
+
+			data = static_cast<const std::byte*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+			size = data ? static_cast<size_t>(file_size.QuadPart) : 0;
+#else
+			fd = open(path.c_str(), O_RDONLY);
+
+			struct stat file_stat = {};
+
+			if ((fd < 0) || (fstat(fd, &file_stat) != 0) || (file_stat.st_size == 0)) {
+				return;
+			}
+
+			auto address = mmap(nullptr, static_cast<size_t>(file_stat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+
+			if (address != MAP_FAILED) {
+				data = static_cast<const std::byte*>(address);
+				size = static_cast<size_t>(file_stat.st_size);
+			}
+#endif
+		}
+
+		~Mapped_file() {
+#ifdef _WIN32
+			if (data) {
+				UnmapViewOfFile(data);
+			}
+			if (mapping) {
+				CloseHandle(mapping);
+			}
+			if (file != INVALID_HANDLE_VALUE) {
+				CloseHandle(file);
+			}
+#else
+			if (data) {
+				munmap(const_cast<std::byte*>(data), size);
+			}
+			if (fd >= 0) {
+				close(fd);
+			}
+#endif
+		}
+
+		Mapped_file(const Mapped_file&) = delete;
+		Mapped_file& operator=(const Mapped_file&) = delete;
+
+		const std::byte* data = nullptr;
+		size_t size = 0;
+	private:
+#ifdef _WIN32
+		HANDLE file = INVALID_HANDLE_VALUE;
+		HANDLE mapping = nullptr;
+#else
+		int fd = -1;
+#endif
+	};
+}
+
+Checkpoint_writer::~Checkpoint_writer() {
+	wait();
+}
+
+void Checkpoint_writer::write_async(const Sim_state& sim, const std::string& path) {
+	wait();
+
+	auto& population = sim.genetic_algorithm->population;
+	auto header = Checkpoint_header();
+
+	header.num_inputs = static_cast<uint32_t>(settings.brain.num_inputs);
+	header.num_hidden = static_cast<uint32_t>(settings.brain.num_hidden);
+	header.num_outputs = static_cast<uint32_t>(settings.brain.num_outputs);
+	header.num_weights = static_cast<uint32_t>(settings.brain.num_weights);
+	header.num_genomes = static_cast<uint32_t>(population.size());
+	header.genome_stride = static_cast<uint32_t>(sim.genetic_algorithm->get_genome_stride());
+	header.generation = sim.generation;
+	header.best_level_overall = sim.best_level_overall;
+	header.best_score_overall = sim.best_score_overall;
+	header.last_clear_physics_step = sim.kill_state.last_clear_physics_step;
+	header.last_clear_no_move = sim.kill_state.last_clear_no_move;
+	header.random_genetic_algorithm = sim.genetic_algorithm->random.get_state();
+	header.random_barrels = sim.barrel_random.get_state();
+	header.fixed_barrel_seed = sim.fixed_barrel_seed;
+	header.offset_fitness = align_up(sizeof(Checkpoint_header));
+	header.offset_pos_previous = align_up(header.offset_fitness + population.size() * sizeof(float));
+	header.offset_weights = align_up(header.offset_pos_previous + 2 * population.size() * sizeof(int32_t));
+
+	auto genome_bytes = header.genome_stride * sizeof(float);
+
+	// Reusing the image keeps its capacity, so only the first checkpoint allocates
+	image.resize(header.offset_weights + population.size() * genome_bytes);
+	std::fill(image.begin(), image.end(), std::byte{ 0 });
+	std::memcpy(image.data(), &header, sizeof(header));
+
+	for (size_t idx_genome = 0; idx_genome < population.size(); idx_genome++) {
+		auto& genome = population[idx_genome];
+		std::memcpy(image.data() + header.offset_fitness + idx_genome * sizeof(float), &genome.fitness, sizeof(float));
+		std::memcpy(image.data() + header.offset_weights + idx_genome * genome_bytes, genome.weights.data(), genome.weights.size_bytes());
+	}
+
+	static_assert(sizeof(int) == sizeof(int32_t));
+	std::memcpy(image.data() + header.offset_pos_previous, sim.kill_state.pos_previous_x.data(), population.size() * sizeof(int32_t));
+	std::memcpy(image.data() + header.offset_pos_previous + population.size() * sizeof(int32_t), sim.kill_state.pos_previous_y.data(), population.size() * sizeof(int32_t));
+
+	thread = std::thread([this, path]() {
+		auto path_tmp = path + ".tmp";
+
+		{
+			auto file = std::ofstream(path_tmp, std::ios::binary | std::ios::trunc);
+			file.write(reinterpret_cast<const char*>(image.data()), static_cast<std::streamsize>(image.size()));
+			ok = file.good();
+		}
+
+		if (ok) {
+			auto error = std::error_code();
+			std::filesystem::rename(path_tmp, path, error);
+			ok = !error;
+		}
+		});
+}
+
+bool Checkpoint_writer::wait() {
+	if (thread.joinable()) {
+		thread.join();
+	}
+
+	return ok;
+}
+
+bool load_checkpoint(Sim_state& sim, const std::string& path) {
+	auto file = Mapped_file(path);
+
+	if (!file.data || (file.size < sizeof(Checkpoint_header))) {
+		std::cerr << "Could not map checkpoint " << path << "\n";
+		return false;
+	}
+
+	auto header = Checkpoint_header();
+	auto expected = Checkpoint_header();
+	auto& population = sim.genetic_algorithm->population;
+
+	std::memcpy(&header, file.data, sizeof(header));
+
+	if (!std::equal(std::begin(header.magic), std::end(header.magic), std::begin(expected.magic))
+		|| (header.version != checkpoint_version) || (header.header_size != sizeof(Checkpoint_header))) {
+		std::cerr << "Checkpoint " << path << " is not a version " << checkpoint_version << " checkpoint\n";
+		return false;
+	}
+
+	if ((header.num_inputs != static_cast<uint32_t>(settings.brain.num_inputs))
+		|| (header.num_hidden != static_cast<uint32_t>(settings.brain.num_hidden))
+		|| (header.num_outputs != static_cast<uint32_t>(settings.brain.num_outputs))
+		|| (header.num_weights != static_cast<uint32_t>(settings.brain.num_weights))) {
+		std::cerr << "Checkpoint " << path << " has a different network topology\n";
+		return false;
+	}
+
+	if (header.num_genomes != population.size()) {
+		std::cerr << "Checkpoint " << path << " holds " << header.num_genomes << " genomes, the population has " << population.size() << "\n";
+		return false;
+	}
+
+	auto genome_bytes = static_cast<size_t>(header.genome_stride) * sizeof(float);
+
+	if ((header.genome_stride < header.num_weights)
+		|| (header.offset_fitness + header.num_genomes * sizeof(float) > file.size)
+		|| (header.offset_pos_previous + 2 * header.num_genomes * sizeof(int32_t) > file.size)
+		|| (header.offset_weights + header.num_genomes * genome_bytes > file.size)) {
+		std::cerr << "Checkpoint " << path << " is truncated\n";
+		return false;
+	}
+
+	for (size_t idx_genome = 0; idx_genome < population.size(); idx_genome++) {
+		auto& genome = population[idx_genome];
+		std::memcpy(&genome.fitness, file.data + header.offset_fitness + idx_genome * sizeof(float), sizeof(float));
+		std::memcpy(genome.weights.data(), file.data + header.offset_weights + idx_genome * genome_bytes, genome.weights.size_bytes());
+	}
+
+	sim.kill_state.pos_previous_x.resize(population.size());
+	sim.kill_state.pos_previous_y.resize(population.size());
+	std::memcpy(sim.kill_state.pos_previous_x.data(), file.data + header.offset_pos_previous, population.size() * sizeof(int32_t));
+	std::memcpy(sim.kill_state.pos_previous_y.data(), file.data + header.offset_pos_previous + population.size() * sizeof(int32_t), population.size() * sizeof(int32_t));
+
+	sim.generation = header.generation;
+	sim.best_level_overall = header.best_level_overall;
+	sim.best_score_overall = header.best_score_overall;
+	sim.kill_state.last_clear_physics_step = header.last_clear_physics_step;
+	sim.kill_state.last_clear_no_move = header.last_clear_no_move;
+	sim.genetic_algorithm->random.set_state(header.random_genetic_algorithm);
+	sim.barrel_random.set_state(header.random_barrels);
+	sim.fixed_barrel_seed = header.fixed_barrel_seed;
+	pack_population_weights(sim);
+
+	return true;
+}
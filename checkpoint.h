@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <simulation.h>
+
+constexpr uint32_t checkpoint_version = 3;
+constexpr size_t checkpoint_alignment = 64;
+
+// Start of a checkpoint file. The file is an image of a single-population Sim_state between
+//	generations, so loading is a map and a few copies: this header, num_genomes fitness values at
+//	offset_fitness, the kill heuristics' num_genomes previous x then num_genomes previous y positions at
+//	offset_pos_previous, then num_genomes genomes of genome_stride floats at offset_weights, each genome
+//	on its own cache line like in the Genetic_algorithm arena. Native endianness, sections 64-byte aligned.
+struct Checkpoint_header {
+	char magic[8] = { 'D', 'O', 'N', 'K', 'E', 'Y', 'C', 'K' };
+	uint32_t version = checkpoint_version;
+	uint32_t header_size = sizeof(Checkpoint_header);
+	// Settings::Brain the weights belong to
+	uint32_t num_inputs = {};
+	uint32_t num_hidden = {};
+	uint32_t num_outputs = {};
+	uint32_t num_weights = {};
+	uint32_t num_genomes = {};
+	uint32_t genome_stride = {};
+	// The next generation to play
+	int32_t generation = {};
+	int32_t best_level_overall = {};
+	float best_score_overall = {};
+	// Kill heuristics carry over between generations
+	int32_t last_clear_physics_step = {};
+	int32_t last_clear_no_move = {};
+	uint32_t reserved = {};
+	Random::State random_genetic_algorithm = {};
+	Random::State random_barrels = {};
+	// Barrels of Evaluation_settings::fixed_seeds, drawn from the run seed, which a resume need not repeat
+	uint64_t fixed_barrel_seed = {};
+	uint64_t offset_fitness = {};
+	uint64_t offset_pos_previous = {};
+	uint64_t offset_weights = {};
+};
+
+// Writes checkpoints on a background thread. The state is copied when write_async is called, so the
+//	simulation carries on while the file is written. Files are written next to path and renamed into
+//	place, so path always holds a complete checkpoint.
+class Checkpoint_writer {
+public:
+	~Checkpoint_writer();
+	// Waits for the previous write first
+	void write_async(const Sim_state& sim, const std::string& path);
+	// Blocks until the last write is done. False if it failed.
+	bool wait();
+private:
+	std::thread thread = {};
+	std::vector<std::byte> image = {};
+	bool ok = true;
+};
+
+// Maps path and copies it into sim, which init_sim_state must have set up with the same population size
+//	and Settings::Brain. Prints the reason and returns false if the file does not fit.
+bool load_checkpoint(Sim_state& sim, const std::string& path);
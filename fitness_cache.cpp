@@ -0,0 +1,31 @@
+#include <bit>
+
+#include <fitness_cache.h>
+
+uint64_t Fitness_cache::key(std::span<const float> weights, uint64_t seed_set) {
+	auto hash = seed_set ^ (weights.size() * 0x9e3779b97f4a7c15ull);
+
+	// Multiply-xorshift per weight. Bitwise, so -0 and 0 are different genomes.
+	for (auto weight : weights) {
+		hash = (hash ^ std::bit_cast<uint32_t>(weight)) * 0xff51afd7ed558ccdull;
+		hash ^= hash >> 32;
+	}
+
+	return hash;
+}
+
+const Fitness_cache::Entry* Fitness_cache::find(uint64_t key) const {
+	auto it = entries.find(key);
+
+	return (it != entries.end()) ? &it->second : nullptr;
+}
+
+void Fitness_cache::insert(uint64_t key, const Entry& entry) {
+	next_entries[key] = entry;
+}
+
+void Fitness_cache::next_generation() {
+	// clear() keeps the buckets, so a steady population stops allocating them
+	entries.swap(next_entries);
+	next_entries.clear();
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+
+// Fitness of the genomes evaluated last generation. Agents never affect each other, so on the same
+//	barrels a genome always scores the same, and elites and copies need not be played again. Entries are
+//	keyed by a 64-bit hash alone: with n genomes per generation, two of them collide with a chance of
+//	about n^2 / 2^65, and one would then be handed the other's fitness.
+class Fitness_cache {
+public:
+	struct Entry {
+		float fitness = {};
+		int best_level = {};
+	};
+
+	// Hash of a genome's weights played on the barrels of seed_set
+	static uint64_t key(std::span<const float> weights, uint64_t seed_set);
+	// Null unless key was inserted in the previous generation
+	const Entry* find(uint64_t key) const;
+	void insert(uint64_t key, const Entry& entry);
+	// Entries inserted since the last call are the ones found from now on, older ones are dropped.
+	//	Genomes that stay in the population are inserted again every generation.
+	void next_generation();
+private:
+	std::unordered_map<uint64_t, Entry> entries = {};
+	std::unordered_map<uint64_t, Entry> next_entries = {};
+};
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <span>
+
+#include <neural_net.h>
+
+// Neural_net with the topology fixed at compile time. Every loop has a known trip count and every weight
+//	offset is a constant, so the compiler can unroll and vectorise them, and there are no sizes to check.
+//	Same summation order and std::tanh as the scalar Neural_net, so both pick the same outputs.
+template <uint32_t In, uint32_t Hidden, uint32_t Out>
+class Fixed_neural_net {
+public:
+	static constexpr uint32_t num_inputs = In;
+	static constexpr uint32_t num_hidden = Hidden;
+	static constexpr uint32_t num_outputs = Out;
+	static constexpr uint32_t num_weights = (In * Hidden) + (Hidden * Out);
+
+	// Input-major hidden weights, then hidden-major output weights, like Neural_net
+	static constexpr uint32_t hidden_weight(uint32_t idx_input, uint32_t idx_hidden) {
+		return idx_input * Hidden + idx_hidden;
+	}
+
+	static constexpr uint32_t output_weight(uint32_t idx_hidden, uint32_t idx_output) {
+		return In * Hidden + idx_hidden * Out + idx_output;
+	}
+
+	// Index of the largest output, the first of equal ones
+	uint32_t forward(std::span<const float, In> inputs, std::span<const float, num_weights> weights) {
+		hidden.fill(0.0f);
+
+		for (uint32_t idx_input = 0; idx_input < In; ++idx_input) {
+			for (uint32_t idx_hidden = 0; idx_hidden < Hidden; ++idx_hidden) {
+				hidden[idx_hidden] += inputs[idx_input] * weights[hidden_weight(idx_input, idx_hidden)];
+			}
+		}
+
+		for (auto& value : hidden) {
+			value = std::tanh(value);
+		}
+
+		outputs.fill(0.0f);
+
+		for (uint32_t idx_output = 0; idx_output < Out; ++idx_output) {
+			for (uint32_t idx_hidden = 0; idx_hidden < Hidden; ++idx_hidden) {
+				outputs[idx_output] += hidden[idx_hidden] * weights[output_weight(idx_hidden, idx_output)];
+			}
+		}
+
+		return static_cast<uint32_t>(std::max_element(outputs.begin(), outputs.end()) - outputs.begin());
+	}
+
+	// Same layouts as Neural_net::forward_batch, at its scalar level. False if batch_weights has another
+	//	topology or is not Fp32.
+	bool forward_batch(const float* inputs, uint32_t input_stride, const Batch_weights& batch_weights,
+		uint32_t idx_genome_begin, uint32_t idx_genome_end, uint32_t* idx_best_outputs) {
+		if ((batch_weights.num_weights != num_weights) || (batch_weights.precision != Weight_precision::Fp32) || (idx_genome_begin > idx_genome_end)
+			|| (idx_genome_end > batch_weights.num_genomes) || (idx_genome_end > input_stride)) {
+			return false;
+		}
+
+		auto idx_genome = idx_genome_begin;
+
+		for (; idx_genome + block_size <= idx_genome_end; idx_genome += block_size) {
+			forward_block<block_size>(inputs, input_stride, batch_weights, idx_genome, idx_best_outputs);
+		}
+
+		for (; idx_genome < idx_genome_end; ++idx_genome) {
+			forward_block<1>(inputs, input_stride, batch_weights, idx_genome, idx_best_outputs);
+		}
+
+		return true;
+	}
+private:
+	// Genomes evaluated together, so the innermost loops run across genomes with a constant trip count
+	static constexpr uint32_t block_size = 16;
+
+	template <uint32_t Lanes>
+	void forward_block(const float* inputs, uint32_t input_stride, const Batch_weights& batch_weights,
+		uint32_t idx_genome, uint32_t* idx_best_outputs) {
+		auto num_genomes = static_cast<size_t>(batch_weights.num_genomes);
+		auto weights = batch_weights.weights.data() + idx_genome;
+		// Locals rather than members, so the compiler knows stores to them do not alias the inputs
+		auto block_hidden = std::array<float, Hidden * Lanes>();
+		auto block_outputs = std::array<float, Out * Lanes>();
+
+		for (uint32_t idx_input = 0; idx_input < In; ++idx_input) {
+			auto input = inputs + static_cast<size_t>(idx_input) * input_stride + idx_genome;
+
+			for (uint32_t idx_hidden = 0; idx_hidden < Hidden; ++idx_hidden) {
+				auto weight = weights + hidden_weight(idx_input, idx_hidden) * num_genomes;
+
+				for (uint32_t idx_lane = 0; idx_lane < Lanes; ++idx_lane) {
+					block_hidden[idx_hidden * Lanes + idx_lane] += input[idx_lane] * weight[idx_lane];
+				}
+			}
+		}
+
+		for (uint32_t idx_hidden = 0; idx_hidden < Hidden; ++idx_hidden) {
+			for (uint32_t idx_lane = 0; idx_lane < Lanes; ++idx_lane) {
+				block_hidden[idx_hidden * Lanes + idx_lane] = std::tanh(block_hidden[idx_hidden * Lanes + idx_lane]);
+			}
+		}
+
+		for (uint32_t idx_hidden = 0; idx_hidden < Hidden; ++idx_hidden) {
+			for (uint32_t idx_output = 0; idx_output < Out; ++idx_output) {
+				auto weight = weights + output_weight(idx_hidden, idx_output) * num_genomes;
+
+				for (uint32_t idx_lane = 0; idx_lane < Lanes; ++idx_lane) {
+					block_outputs[idx_output * Lanes + idx_lane] += block_hidden[idx_hidden * Lanes + idx_lane] * weight[idx_lane];
+				}
+			}
+		}
+
+		for (uint32_t idx_lane = 0; idx_lane < Lanes; ++idx_lane) {
+			auto idx_best_output = uint32_t{};
+
+			for (uint32_t idx_output = 1; idx_output < Out; ++idx_output) {
+				if (block_outputs[idx_best_output * Lanes + idx_lane] < block_outputs[idx_output * Lanes + idx_lane]) {
+					idx_best_output = idx_output;
+				}
+			}
+
+			idx_best_outputs[idx_genome + idx_lane] = idx_best_output;
+		}
+	}
+
+	std::array<float, Hidden> hidden = {};
+	std::array<float, Out> outputs = {};
+};
+
+// The topology of Settings::Brain
+using Brain_neural_net = Fixed_neural_net<9, 18, 3>;
@@ -1,21 +1,141 @@
 #include <algorithm>
 #include <cmath>
+#include <iostream>
+#include <new>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 #include <genetic_algorithm.h>
 
-Genetic_algorithm::Genome::Genome(uint32_t num_weights) {
-	weights.resize(num_weights);
+const char* selection_name(Selection selection) {
+	switch (selection) {
+	case Selection::Truncation: return "truncation";
+	case Selection::Tournament: return "tournament";
+	case Selection::Rank: return "rank";
+	case Selection::Stochastic_universal: return "sus";
+	}
+
+	return "unknown";
+}
+
+Genetic_algorithm::Arena::~Arena() {
+	if (!is_mapped) {
+		if (floats) {
+			::operator delete[](floats, std::align_val_t(arena_alignment));
+		}
+		return;
+	}
+
+#ifdef _WIN32
+	UnmapViewOfFile(floats);
+	CloseHandle(mapping);
+	CloseHandle(file);
+#else
+	munmap(floats, num_bytes);
+	close(fd);
+#endif
+}
+
+void Genetic_algorithm::Arena::allocate(size_t num_floats) {
+	floats = static_cast<float*>(::operator new[](num_floats * sizeof(float), std::align_val_t(arena_alignment)));
+	num_bytes = num_floats * sizeof(float);
+	std::fill_n(floats, num_floats, 0.0f);
+}
+
+bool Genetic_algorithm::Arena::map_file(const std::string& path, size_t num_floats) {
+	num_bytes = num_floats * sizeof(float);
+
+	// A fresh file reads as zeros, and mappings start on a page, so on a cache line too. The file is
+	//	scratch space: never an existing one, and gone once the arena is, even if the process dies.
+#ifdef _WIN32
+	auto file_handle = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_NEW,
+		FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+
+	if (file_handle == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	auto size = ULARGE_INTEGER();
+	size.QuadPart = num_bytes;
+	auto mapping_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READWRITE, size.HighPart, size.LowPart, nullptr);
+	auto view = mapping_handle ? MapViewOfFile(mapping_handle, FILE_MAP_ALL_ACCESS, 0, 0, 0) : nullptr;
+
+	if (!view) {
+		if (mapping_handle) {
+			CloseHandle(mapping_handle);
+		}
+		CloseHandle(file_handle);
+		return false;
+	}
+
+	file = file_handle;
+	mapping = mapping_handle;
+	floats = static_cast<float*>(view);
+#else
+	auto file_fd = open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+
+	if (file_fd < 0) {
+		return false;
+	}
+
+	// The mapping keeps the data until it is unmapped
+	unlink(path.c_str());
+
+	auto address = (ftruncate(file_fd, static_cast<off_t>(num_bytes)) == 0)
+		? mmap(nullptr, num_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, file_fd, 0) : MAP_FAILED;
 
-	for (auto& weight : weights) {
-		weight = ((rand() / (float)RAND_MAX) * 2.0f - 1.0f);
+	if (address == MAP_FAILED) {
+		close(file_fd);
+		return false;
 	}
+
+	fd = file_fd;
+	floats = static_cast<float*>(address);
+#endif
+
+	is_mapped = true;
+
+	return true;
 }
 
-Genetic_algorithm::Genetic_algorithm(uint32_t num_genomes, uint32_t num_weights_per_genome) {
-	population.reserve(num_genomes);
+float* Genetic_algorithm::Arena::data() const {
+	return floats;
+}
+
+Genetic_algorithm::Genetic_algorithm(uint32_t num_genomes, uint32_t num_weights_per_genome, const Random& random_source, const std::string& arena_path) : random(random_source) {
+	auto floats_per_line = arena_alignment / sizeof(float);
+	genome_stride = (num_weights_per_genome + floats_per_line - 1) / floats_per_line * floats_per_line;
+
+	auto num_floats = 2 * genome_stride * num_genomes;
+
+	if (arena_path.empty()) {
+		arena.allocate(num_floats);
+	}
+	else if (!arena.map_file(arena_path, num_floats)) {
+		std::cerr << "Could not map a population of " << num_genomes << " genomes to " << arena_path << ", which must not exist yet\n";
+		return;
+	}
+
+	coins.resize(num_weights_per_genome);
+	mutation_chances.resize(num_weights_per_genome);
+	mutation_noise.resize(num_weights_per_genome);
+	population.resize(num_genomes);
+	next_population.resize(num_genomes);
+	ranking.resize(num_genomes);
+	idx_parents.resize(2 * static_cast<size_t>(num_genomes));
 
 	for (uint32_t idx_genome = 0; idx_genome < num_genomes; idx_genome++) {
-		population.push_back(Genome(num_weights_per_genome));
+		population[idx_genome].weights = { arena.data() + idx_genome * genome_stride, num_weights_per_genome };
+		next_population[idx_genome].weights = { arena.data() + (num_genomes + idx_genome) * genome_stride, num_weights_per_genome };
+
+		random.fill_uniform(population[idx_genome].weights, -1.0f, 1.0f);
 	}
 }
 
@@ -27,44 +147,162 @@ bool Genetic_algorithm::crossover(const Genome& parent_a, const Genome& parent_b
 
 	auto num_weights = parent_a.weights.size();
 
-	for (int idx_weight = 0; idx_weight < num_weights; ++idx_weight) {
-		child.weights[idx_weight] = (rand() % 2 == 0) ? parent_a.weights[idx_weight] : parent_b.weights[idx_weight];
+	if (num_weights > coins.size()) {
+		return false;
+	}
+
+	random.fill_coins({ coins.data(), num_weights });
+
+	for (size_t idx_weight = 0; idx_weight < num_weights; ++idx_weight) {
+		child.weights[idx_weight] = coins[idx_weight] ? parent_b.weights[idx_weight] : parent_a.weights[idx_weight];
 	}
 
 	return true;
 }
 
 void Genetic_algorithm::mutate(Genome& g) {
-	for (float& w : g.weights) {
-		if ((rand() / (float)RAND_MAX) < mutation_rate) {
-			w += ((rand() / (float)RAND_MAX) * 2.0f - 1.0f) * mutation_stddev; // small tweak
+	auto num_weights = std::min(g.weights.size(), mutation_noise.size());
+
+	random.fill_uniform({ mutation_chances.data(), num_weights }, 0.0f, 1.0f);
+	random.fill_gaussian({ mutation_noise.data(), num_weights }, 0.0f, mutation_stddev);
+
+	for (size_t idx_weight = 0; idx_weight < num_weights; ++idx_weight) {
+		g.weights[idx_weight] += (mutation_chances[idx_weight] < mutation_rate) ? mutation_noise[idx_weight] : 0.0f; // small tweak
+	}
+}
+
+uint32_t num_elites(uint32_t num_genomes) {
+	return static_cast<uint32_t>(std::ceil(num_genomes * elites_rate));
+}
+
+uint32_t Genetic_algorithm::num_elites() const {
+	return ::num_elites(static_cast<uint32_t>(population.size()));
+}
+
+size_t Genetic_algorithm::get_genome_stride() const {
+	return genome_stride;
+}
+
+void Genetic_algorithm::select_parents() {
+	auto num_genomes = static_cast<uint32_t>(population.size());
+	auto num_elites = this->num_elites();
+	auto num_parents = 2 * static_cast<size_t>(num_genomes - num_elites);
+	// Equal fitness goes to the lower index, so the order does not depend on the standard library
+	auto fitter = [](const Ranked& ranked1, const Ranked& ranked2) {
+		return (ranked1.fitness > ranked2.fitness) || ((ranked1.fitness == ranked2.fitness) && (ranked1.idx_genome < ranked2.idx_genome));
+		};
+
+	for (uint32_t idx_genome = 0; idx_genome < num_genomes; idx_genome++) {
+		ranking[idx_genome] = { population[idx_genome].fitness, idx_genome };
+	}
+
+	// Only rank selection needs every genome in order, the others only the elites: O(n) to split them off
+	//	and O(k log k) to order them
+	if (selection == Selection::Rank) {
+		std::sort(ranking.begin(), ranking.end(), fitter);
+	}
+	else if (num_elites > 0) {
+		std::nth_element(ranking.begin(), ranking.begin() + (num_elites - 1), ranking.end(), fitter);
+		std::sort(ranking.begin(), ranking.begin() + num_elites, fitter);
+	}
+
+	switch (selection) {
+	case Selection::Truncation:
+		for (size_t idx_parent = 0; idx_parent < num_parents; idx_parent++) {
+			idx_parents[idx_parent] = ranking[random.below(num_elites)].idx_genome;
+		}
+		break;
+	case Selection::Tournament:
+		for (size_t idx_parent = 0; idx_parent < num_parents; idx_parent++) {
+			// Any order of the genomes will do, and the compact table keeps the random reads in cache longer
+			auto best = ranking[random.below(num_genomes)];
+
+			for (uint32_t idx_round = 1; idx_round < tournament_size; idx_round++) {
+				auto& entrant = ranking[random.below(num_genomes)];
+				best = (entrant.fitness > best.fitness) ? entrant : best;
+			}
+
+			idx_parents[idx_parent] = best.idx_genome;
+		}
+		break;
+	case Selection::Rank:
+		for (size_t idx_parent = 0; idx_parent < num_parents; idx_parent++) {
+			// Inverse of the CDF of a density falling linearly from 2 at the fittest to 0
+			auto position = 1.0f - std::sqrt(1.0f - random.uniform());
+			auto idx_rank = std::min(static_cast<uint32_t>(position * num_genomes), num_genomes - 1);
+			idx_parents[idx_parent] = ranking[idx_rank].idx_genome;
+		}
+		break;
+	case Selection::Stochastic_universal: {
+		auto min_fitness = std::min_element(ranking.begin(), ranking.end(), [](const Ranked& ranked1, const Ranked& ranked2) {
+			return ranked1.fitness < ranked2.fitness;
+			})->fitness;
+		auto total = 0.0;
+
+		for (auto& ranked : ranking) {
+			total += ranked.fitness - min_fitness;
+		}
+
+		if (total <= 0.0) {
+			for (size_t idx_parent = 0; idx_parent < num_parents; idx_parent++) {
+				idx_parents[idx_parent] = random.below(num_genomes);
+			}
+			break;
 		}
+
+		// One spin, num_parents equally spaced pointers, one pass over the population
+		auto spacing = total / static_cast<double>(num_parents);
+		auto pointer = random.uniform() * spacing;
+		auto cumulative = 0.0;
+		auto idx_ranked = uint32_t{};
+
+		for (size_t idx_parent = 0; idx_parent < num_parents; idx_parent++) {
+			while ((idx_ranked + 1 < num_genomes) && (cumulative + (ranking[idx_ranked].fitness - min_fitness) <= pointer)) {
+				cumulative += ranking[idx_ranked].fitness - min_fitness;
+				idx_ranked++;
+			}
+
+			idx_parents[idx_parent] = ranking[idx_ranked].idx_genome;
+			pointer += spacing;
+		}
+
+		// The pointers come out in table order, so shuffle them before they are paired
+		for (auto idx_parent = num_parents; idx_parent > 1; idx_parent--) {
+			std::swap(idx_parents[idx_parent - 1], idx_parents[random.below(static_cast<uint32_t>(idx_parent))]);
+		}
+		break;
+	}
 	}
 }
 
 bool Genetic_algorithm::new_generation() {
-	std::sort(population.begin(), population.end(), [](const Genome& genome1, const Genome& genome2) {return genome1.fitness > genome2.fitness; });
 	auto num_genomes = population.size();
-	auto new_population = std::vector<Genome>();
-	auto num_elites = static_cast<uint32_t>(std::ceil(num_genomes * elites_rate));
+	auto num_elites = this->num_elites();
 
-	new_population.insert(new_population.end(), population.begin(), population.begin() + num_elites);
+	select_parents();
 
-	while (new_population.size() < num_genomes) {
-		auto& parent_a = population[rand() % num_elites];
-		auto& parent_b = population[rand() % num_elites];
-		auto num_weights = static_cast<uint32_t>(parent_a.weights.size());
-		auto child = Genome(num_weights);
+	for (uint32_t idx_elite = 0; idx_elite < num_elites; idx_elite++) {
+		auto& elite = population[ranking[idx_elite].idx_genome];
+		auto& next = next_population[idx_elite];
+		std::copy(elite.weights.begin(), elite.weights.end(), next.weights.begin());
+		next.fitness = elite.fitness;
+	}
+
+	for (size_t idx_child = num_elites; idx_child < num_genomes; idx_child++) {
+		auto idx_pair = 2 * (idx_child - num_elites);
+		auto& parent_a = population[idx_parents[idx_pair]];
+		auto& parent_b = population[idx_parents[idx_pair + 1]];
+		auto& child = next_population[idx_child];
 
 		if (!crossover(parent_a, parent_b, child)) {
 			return false;
 		}
 
 		mutate(child);
-		new_population.push_back(child);
+		child.fitness = 0.0f;
 	}
 
-	population = new_population;
+	std::swap(population, next_population);
 
 	return true;
-}
\ No newline at end of file
+}
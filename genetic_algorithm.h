@@ -1,24 +1,107 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
 #include <vector>
 
+#include <random.h>
+
 constexpr float mutation_rate = 0.1f;
 constexpr float mutation_stddev = 0.2f;
 constexpr float elites_rate = 0.05f;
+// Genomes drawn per parent by Selection::Tournament
+constexpr uint32_t tournament_size = 3;
+
+// How new_generation picks the parents of the children. The elites are carried over either way.
+enum class Selection {
+	// Uniformly among the elites
+	Truncation,
+	// The fittest of tournament_size genomes drawn uniformly
+	Tournament,
+	// Linear ranking, the fittest genome twice as likely as the average one
+	Rank,
+	// Stochastic universal sampling, in proportion to fitness above the least fit genome
+	Stochastic_universal
+};
+
+const char* selection_name(Selection selection);
+
+// Genomes a population of num_genomes carries over unchanged each generation
+uint32_t num_elites(uint32_t num_genomes);
 
 class Genetic_algorithm {
 public:
+	// View of one genome's weights in the arena
 	struct Genome {
-		Genome(uint32_t num_weights);
-
-		std::vector<float> weights = {};
+		std::span<float> weights = {};
 		float fitness = 0.0f;
 	};
 
-	Genetic_algorithm(uint32_t num_genomes, uint32_t num_weights_per_genome);
+	// With an arena_path, both generations live in that file, mapped into memory, so the population is
+	//	limited by disk rather than RAM and only the pages in use stay resident. The file is scratch space:
+	//	it must not exist yet and is deleted again. Prints the reason and leaves population empty if it
+	//	cannot be created and mapped.
+	Genetic_algorithm(uint32_t num_genomes, uint32_t num_weights_per_genome, const Random& random_source, const std::string& arena_path = {});
 	bool crossover(const Genome& parent_a, const Genome& parent_b, Genome& child);
 	void mutate(Genome& g);
+	// Ranks the elites and picks two parents per child, as indices into population. Does not allocate.
+	void select_parents();
+	// Selects, then breeds into the other half of the arena and swaps. Does not allocate.
 	bool new_generation();
+	// Genomes carried over unchanged by new_generation, placed first and best first
+	uint32_t num_elites() const;
+	// Floats from one genome's start to the next in the arena, a whole number of cache lines
+	size_t get_genome_stride() const;
 
 	std::vector<Genome> population = {};
+	Random random = {};
+	Selection selection = Selection::Truncation;
+private:
+	struct Ranked {
+		float fitness = 0.0f;
+		uint32_t idx_genome = 0;
+	};
+
+	// Both generations in one cache-line aligned block, on the heap or mapped from a file. Every genome
+	//	starts on a cache line.
+	class Arena {
+	public:
+		Arena() = default;
+		~Arena();
+		Arena(const Arena&) = delete;
+		Arena& operator=(const Arena&) = delete;
+
+		// Zeroed either way. map_file returns false if the file exists or could not be created and mapped.
+		void allocate(size_t num_floats);
+		bool map_file(const std::string& path, size_t num_floats);
+		float* data() const;
+	private:
+		float* floats = nullptr;
+		size_t num_bytes = 0;
+		bool is_mapped = false;
+#ifdef _WIN32
+		// HANDLEs, kept out of this header
+		void* file = nullptr;
+		void* mapping = nullptr;
+#else
+		int fd = -1;
+#endif
+	};
+
+	static constexpr size_t arena_alignment = 64;
+
+	Arena arena = {};
+	std::vector<Genome> next_population = {};
+	size_t genome_stride = {};
+	// Compact (fitness, index) table for selection, fittest first for the genomes select_parents ranked.
+	//	Selection only ever moves these, never genomes.
+	std::vector<Ranked> ranking = {};
+	// Parents of child idx_child are idx_parents[2 * idx_child] and idx_parents[2 * idx_child + 1]
+	std::vector<uint32_t> idx_parents = {};
+	// Per-weight random numbers, drawn in bulk so crossover and mutation are plain select/add loops
+	std::vector<uint8_t> coins = {};
+	std::vector<float> mutation_chances = {};
+	std::vector<float> mutation_noise = {};
 };
\ No newline at end of file
@@ -0,0 +1,461 @@
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <string>
+
+#include <checkpoint.h>
+#include <island.h>
+#include <profile.h>
+#include <replay.h>
+#include <simulation.h>
+
+struct Headless_options {
+	int num_generations = 100;
+	int num_agents = settings.game.num_agents;
+	// Extra worker threads for agent stepping, 0 steps all agents on the main thread
+	int num_threads = 0;
+	Simd_level simd_level = detect_simd_level();
+	uint64_t seed = std::random_device()();
+	// Zero runs one population, otherwise see run_islands
+	Island_settings island_settings = { 0 };
+	Evaluation_settings evaluation = {};
+	Selection selection = Selection::Truncation;
+	// Written every checkpoint_interval generations when set
+	std::string checkpoint_path = {};
+	int checkpoint_interval = 10;
+	std::string resume_path = {};
+	// Each generation's best agent is recorded to record_dir/generation_N.replay when set
+	std::string record_dir = {};
+	// Re-simulates a replay and checks it against the recorded scores instead of training
+	std::string play_path = {};
+	// Genomes live in this scratch file rather than in memory when set. It must not exist and is deleted
+	//	again. Implies evaluating in blocks.
+	std::string population_path = {};
+	// Per-generation phase timings are written to profile_path as CSV when set. Needs a DONKEY_PROFILE build.
+	std::string profile_path = {};
+};
+
+void print_usage(const char* program_name) {
+	std::cout << "Usage: " << program_name << " [--generations N] [--population N] [--threads N] [--simd scalar|sse4.2|avx2|avx512] [--seed N]\n"
+		<< "       [--islands N] [--migration-interval N] [--migrants N] [--episodes N] [--fitness mean|min|qPERCENT]\n"
+		<< "       [--fixed-seeds] [--no-fitness-cache] [--weights fp32|fp16|int8] [--population-file PATH] [--block N]\n"
+		<< "       [--selection truncation|tournament|rank|sus]\n"
+		<< "       [--checkpoint PATH] [--checkpoint-interval N] [--resume PATH] [--record DIR] [--play PATH]\n"
+		<< "       [--profile PATH]\n"
+		<< "\n"
+		<< "--population-file keeps the genomes in a new scratch file, deleted at exit, and evaluates in blocks of\n"
+		<< "--block agents (default " << default_agents_per_block << "). Blocks of a single episode give the same run as without them.\n";
+}
+
+bool parse_options(int argc, char** argv, Headless_options& options) {
+	for (auto idx_arg = 1; idx_arg < argc; idx_arg++) {
+		auto arg = std::string(argv[idx_arg]);
+		auto has_value = (idx_arg + 1 < argc);
+
+		if (arg == "--generations" && has_value) {
+			options.num_generations = std::atoi(argv[++idx_arg]);
+		}
+		else if (arg == "--population" && has_value) {
+			options.num_agents = std::atoi(argv[++idx_arg]);
+		}
+		else if (arg == "--threads" && has_value) {
+			options.num_threads = std::atoi(argv[++idx_arg]);
+		}
+		else if (arg == "--seed" && has_value) {
+			options.seed = std::strtoull(argv[++idx_arg], nullptr, 10);
+		}
+		else if (arg == "--islands" && has_value) {
+			options.island_settings.num_islands = static_cast<uint32_t>(std::atoi(argv[++idx_arg]));
+		}
+		else if (arg == "--migration-interval" && has_value) {
+			options.island_settings.migration_interval = static_cast<uint32_t>(std::atoi(argv[++idx_arg]));
+		}
+		else if (arg == "--migrants" && has_value) {
+			options.island_settings.num_migrants = static_cast<uint32_t>(std::atoi(argv[++idx_arg]));
+		}
+		else if (arg == "--episodes" && has_value) {
+			options.evaluation.num_episodes = static_cast<uint32_t>(std::atoi(argv[++idx_arg]));
+		}
+		else if (arg == "--fixed-seeds") {
+			options.evaluation.fixed_seeds = true;
+		}
+		else if (arg == "--no-fitness-cache") {
+			options.evaluation.cache_fitness = false;
+		}
+		else if (arg == "--weights" && has_value) {
+			auto name = std::string(argv[++idx_arg]);
+			auto found = false;
+
+			for (auto precision : { Weight_precision::Fp32, Weight_precision::Fp16, Weight_precision::Int8 }) {
+				if (name == weight_precision_name(precision)) {
+					options.evaluation.weight_precision = precision;
+					found = true;
+				}
+			}
+
+			if (!found) {
+				return false;
+			}
+		}
+		else if (arg == "--selection" && has_value) {
+			auto name = std::string(argv[++idx_arg]);
+			auto found = false;
+
+			for (auto selection : { Selection::Truncation, Selection::Tournament, Selection::Rank, Selection::Stochastic_universal }) {
+				if (name == selection_name(selection)) {
+					options.selection = selection;
+					found = true;
+				}
+			}
+
+			if (!found) {
+				return false;
+			}
+		}
+		else if (arg == "--fitness" && has_value) {
+			auto name = std::string(argv[++idx_arg]);
+
+			if (name == "mean") {
+				options.evaluation.reduction = Fitness_reduction::Mean;
+			}
+			else if (name == "min") {
+				options.evaluation.reduction = Fitness_reduction::Min;
+			}
+			else if ((name.size() > 1) && (name[0] == 'q')) {
+				// q25 is the 25th percentile
+				auto percent = 0;
+				auto [end, error] = std::from_chars(name.data() + 1, name.data() + name.size(), percent);
+
+				if ((error != std::errc()) || (end != name.data() + name.size()) || (percent < 0) || (percent > 100)) {
+					return false;
+				}
+
+				options.evaluation.reduction = Fitness_reduction::Quantile;
+				options.evaluation.quantile = percent / 100.0f;
+			}
+			else {
+				return false;
+			}
+		}
+		else if (arg == "--population-file" && has_value) {
+			options.population_path = argv[++idx_arg];
+		}
+		else if (arg == "--block" && has_value) {
+			options.evaluation.agents_per_block = static_cast<uint32_t>(std::atoi(argv[++idx_arg]));
+		}
+		else if (arg == "--checkpoint" && has_value) {
+			options.checkpoint_path = argv[++idx_arg];
+		}
+		else if (arg == "--checkpoint-interval" && has_value) {
+			options.checkpoint_interval = std::atoi(argv[++idx_arg]);
+		}
+		else if (arg == "--resume" && has_value) {
+			options.resume_path = argv[++idx_arg];
+		}
+		else if (arg == "--record" && has_value) {
+			options.record_dir = argv[++idx_arg];
+		}
+		else if (arg == "--play" && has_value) {
+			options.play_path = argv[++idx_arg];
+		}
+		else if (arg == "--profile" && has_value) {
+			options.profile_path = argv[++idx_arg];
+		}
+		else if (arg == "--simd" && has_value) {
+			auto name = std::string(argv[++idx_arg]);
+			auto found = false;
+
+			for (auto simd_level : { Simd_level::Scalar, Simd_level::Sse42, Simd_level::Avx2, Simd_level::Avx512 }) {
+				if (name == simd_level_name(simd_level)) {
+					options.simd_level = simd_level;
+					found = true;
+				}
+			}
+
+			if (!found) {
+				return false;
+			}
+		}
+		else {
+			return false;
+		}
+	}
+
+	return (options.num_generations > 0) && (options.num_agents > 0) && (options.num_threads >= 0) && (options.island_settings.migration_interval > 0)
+		&& (options.checkpoint_interval > 0);
+}
+
+int play_replay(const std::string& path, const Level& level) {
+	auto player = Replay_player();
+
+	if (!player.load(path, level)) {
+		return -1;
+	}
+
+	while (player.step(level)) {
+	}
+
+	auto& agents = player.get_agents();
+	auto& players = player.state().players;
+	auto num_mismatches = 0;
+
+	for (size_t idx_agent = 0; idx_agent < agents.size(); idx_agent++) {
+		auto& agent = agents[idx_agent];
+
+		std::cout << "Agent " << agent.idx_agent << " of generation " << player.get_header().generation << ": score " << players.score[idx_agent]
+			<< " (recorded " << agent.score << "), level " << players.level[idx_agent] << " (recorded " << agent.level << ")\n";
+
+		if ((players.score[idx_agent] != agent.score) || (players.level[idx_agent] != agent.level)) {
+			num_mismatches++;
+		}
+	}
+
+	std::cout << "Replayed " << player.num_steps() << " steps, " << num_mismatches << " agents differ from the recording" << std::endl;
+
+	return (num_mismatches == 0) ? 0 : -1;
+}
+
+// The first option given that islands do not support, or nullptr. run_islands plays every island in a
+//	plain Sim_state on its own thread and writes nothing but its log.
+const char* single_population_option(const Headless_options& options) {
+	auto& evaluation = options.evaluation;
+
+	if (options.num_threads > 0) {
+		return "--threads";
+	}
+	if (evaluation.num_episodes > 1) {
+		return "--episodes";
+	}
+	if (evaluation.reduction != Fitness_reduction::Mean) {
+		return "--fitness";
+	}
+	if (evaluation.fixed_seeds) {
+		return "--fixed-seeds";
+	}
+	if (!evaluation.cache_fitness) {
+		return "--no-fitness-cache";
+	}
+	if (evaluation.weight_precision != Weight_precision::Fp32) {
+		return "--weights";
+	}
+	if (!options.population_path.empty()) {
+		return "--population-file";
+	}
+	if (evaluation.agents_per_block > 0) {
+		return "--block";
+	}
+	if (options.selection != Selection::Truncation) {
+		return "--selection";
+	}
+	if (!options.checkpoint_path.empty()) {
+		return "--checkpoint";
+	}
+	if (!options.resume_path.empty()) {
+		return "--resume";
+	}
+	if (!options.record_dir.empty()) {
+		return "--record";
+	}
+	if (!options.profile_path.empty()) {
+		// Islands never pause together, so there is no point where every thread's counters can be read
+		return "--profile";
+	}
+
+	return nullptr;
+}
+
+int main(int argc, char** argv) {
+	auto options = Headless_options();
+
+	if (!parse_options(argc, argv, options)) {
+		print_usage(argv[0]);
+		return -1;
+	}
+
+	settings.game.num_agents = options.num_agents;
+	settings.game.seed = options.seed;
+
+	auto level = Level(generate_level(settings.gui.num_squares_x), player_width / 2);
+	auto thread_pool = std::unique_ptr<Thread_pool>();
+
+	if (!options.play_path.empty()) {
+		return play_replay(options.play_path, level);
+	}
+
+#ifndef DONKEY_PROFILE
+	if (!options.profile_path.empty()) {
+		std::cerr << "--profile needs a build configured with -DDONKEY_PROFILE=ON\n";
+		return -1;
+	}
+#endif
+
+	if (detect_simd_level() < options.simd_level) {
+		std::cerr << "SIMD level " << simd_level_name(options.simd_level) << " is not supported on this CPU\n";
+		return -1;
+	}
+
+	std::cout << "Neural net kernels: " << simd_level_name(options.simd_level) << std::endl;
+	std::cout << "Seed: " << settings.game.seed << std::endl;
+
+	if (options.island_settings.num_islands > 0) {
+		if (auto option = single_population_option(options)) {
+			std::cerr << option << " needs a single population\n";
+			return -1;
+		}
+
+		// Migrants are an island's elites
+		if (options.island_settings.num_migrants > num_elites(static_cast<uint32_t>(options.num_agents))) {
+			std::cerr << "--migrants is above the " << num_elites(static_cast<uint32_t>(options.num_agents)) << " elites of a population of "
+				<< options.num_agents << "\n";
+			return -1;
+		}
+
+		auto time_start = std::chrono::steady_clock::now();
+
+		std::cout << "Islands: " << options.island_settings.num_islands << ", migrating " << options.island_settings.num_migrants
+			<< " genomes every " << options.island_settings.migration_interval << " generations" << std::endl;
+		run_islands(options.island_settings, settings.game.seed, options.num_generations, level, options.simd_level);
+		std::cout << "Ran " << options.num_generations << " generations on " << options.island_settings.num_islands << " islands in "
+			<< std::chrono::duration<double>(std::chrono::steady_clock::now() - time_start).count() << "s" << std::endl;
+
+		return 0;
+	}
+
+	if (options.num_threads > 0) {
+		thread_pool = std::make_unique<Thread_pool>(options.num_threads);
+	}
+
+	if (options.evaluation.num_episodes > 1) {
+		std::cout << "Episodes per generation: " << options.evaluation.num_episodes << std::endl;
+	}
+
+	if (options.evaluation.weight_precision != Weight_precision::Fp32) {
+		std::cout << "Network weights: " << weight_precision_name(options.evaluation.weight_precision) << std::endl;
+	}
+
+	if (options.evaluation.fixed_seeds) {
+		std::cout << "Fixed barrel seeds, fitness cache " << (options.evaluation.cache_fitness ? "on" : "off") << std::endl;
+	}
+
+	if (!options.population_path.empty() && (options.evaluation.agents_per_block == 0)) {
+		// Packing the whole population for one evaluation would bring it all back into memory
+		options.evaluation.agents_per_block = default_agents_per_block;
+	}
+
+	if (options.selection != Selection::Truncation) {
+		std::cout << "Selection: " << selection_name(options.selection) << std::endl;
+	}
+
+	if (options.evaluation.agents_per_block > 0) {
+		std::cout << "Evaluating in blocks of " << options.evaluation.agents_per_block << " agents" << std::endl;
+	}
+
+	auto sim = Sim_state();
+
+	settings.game.population_path = options.population_path;
+	sim.evaluation = options.evaluation;
+	init_sim_state(sim, settings.game.seed, thread_pool.get());
+
+	if (sim.genetic_algorithm->population.empty()) {
+		return -1;
+	}
+
+	sim.genetic_algorithm->selection = options.selection;
+
+	for (auto& net : sim.neural_nets) {
+		net.set_simd_level(options.simd_level);
+	}
+
+	if (!options.resume_path.empty()) {
+		auto time_load_start = std::chrono::steady_clock::now();
+
+		if (!load_checkpoint(sim, options.resume_path)) {
+			return -1;
+		}
+
+		std::cout << "Resumed at generation " << sim.generation << " from " << options.resume_path << " in "
+			<< std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - time_load_start).count() << "ms" << std::endl;
+	}
+
+	auto checkpoint_writer = Checkpoint_writer();
+	auto recorder = std::unique_ptr<Replay_recorder>();
+
+	if (!options.record_dir.empty()) {
+		if (uses_episodes(options.evaluation)) {
+			std::cerr << "Recording needs a single episode per generation without fixed seeds, blocks or a population file\n";
+			return -1;
+		}
+
+		recorder = std::make_unique<Replay_recorder>();
+	}
+
+#ifdef DONKEY_PROFILE
+	auto profile_report = Profile_report();
+
+	if (!options.profile_path.empty() && !profile_report.open(options.profile_path)) {
+		std::cerr << "Could not write profile " << options.profile_path << "\n";
+		return -1;
+	}
+
+	// Drops anything recorded while setting up
+	profile_collect();
+#endif
+
+	auto num_generations_run = 0;
+	auto num_steps_total = int64_t{};
+	auto time_start = std::chrono::steady_clock::now();
+
+	// --generations counts from the start of the run, so a resumed run stops at the same generation
+	while (sim.generation <= options.num_generations) {
+#ifdef DONKEY_PROFILE
+		auto time_generation_start = std::chrono::steady_clock::now();
+#endif
+
+		// Same pipeline as the windowed main loop, but stepped as fast as possible instead of at physics_update_rate_hz
+		num_steps_total += run_generation(sim, level, recorder.get());
+		std::cout << "===\nDone with generation " << sim.generation << " after " << sim.num_physics_steps << " steps" << std::endl;
+
+		if (recorder) {
+			auto& scores = sim.players.score;
+			auto idx_best = static_cast<uint32_t>(std::max_element(scores.begin(), scores.end()) - scores.begin());
+			auto path = (std::filesystem::path(options.record_dir) / ("generation_" + std::to_string(sim.generation) + ".replay")).string();
+
+			if (!recorder->write(path, std::span<const uint32_t>(&idx_best, 1), sim)) {
+				std::cerr << "Could not write replay " << path << "\n";
+			}
+		}
+
+		next_generation(sim);
+		std::cout << "===\n";
+		num_generations_run++;
+
+		auto generation_done = sim.generation - 1;
+
+#ifdef DONKEY_PROFILE
+		if (!options.profile_path.empty()) {
+			profile_report.write(generation_done, std::chrono::duration<double>(std::chrono::steady_clock::now() - time_generation_start).count(), profile_collect());
+		}
+#endif
+
+		if (!options.checkpoint_path.empty()
+			&& ((generation_done % options.checkpoint_interval == 0) || (generation_done == options.num_generations))) {
+			checkpoint_writer.write_async(sim, options.checkpoint_path);
+		}
+	}
+
+	if (!checkpoint_writer.wait()) {
+		std::cerr << "Could not write checkpoint " << options.checkpoint_path << "\n";
+	}
+
+	auto time_total_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - time_start).count();
+
+	std::cout << "Ran " << num_generations_run << " generations (" << num_steps_total << " steps) in " << time_total_s << "s: "
+		<< num_steps_total / time_total_s << " steps/s, "
+		<< num_steps_total * settings.game.num_agents / time_total_s << " agent-steps/s" << std::endl;
+
+	return 0;
+}
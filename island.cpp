@@ -0,0 +1,109 @@
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <island.h>
+
+Migration_queue::Migration_queue(uint32_t capacity, uint32_t num_weights) {
+	slots.resize(capacity + 1, std::vector<float>(num_weights));
+}
+
+bool Migration_queue::push(std::span<const float> weights) {
+	auto idx_cur = idx_write.load(std::memory_order_relaxed);
+	auto idx_next = (idx_cur + 1) % static_cast<uint32_t>(slots.size());
+
+	if (idx_next == idx_read.load(std::memory_order_acquire)) {
+		return false;
+	}
+
+	std::copy(weights.begin(), weights.end(), slots[idx_cur].begin());
+	idx_write.store(idx_next, std::memory_order_release);
+
+	return true;
+}
+
+bool Migration_queue::pop(std::span<float> weights) {
+	auto idx_cur = idx_read.load(std::memory_order_relaxed);
+
+	if (idx_cur == idx_write.load(std::memory_order_acquire)) {
+		return false;
+	}
+
+	std::copy(slots[idx_cur].begin(), slots[idx_cur].end(), weights.begin());
+	idx_read.store((idx_cur + 1) % static_cast<uint32_t>(slots.size()), std::memory_order_release);
+
+	return true;
+}
+
+void run_islands(const Island_settings& island_settings, uint64_t seed, int num_generations, const Level& level, Simd_level simd_level) {
+	auto num_islands = island_settings.num_islands;
+	auto queues = std::vector<std::unique_ptr<Migration_queue>>();
+	auto threads = std::vector<std::thread>();
+	auto mutex_log = std::mutex();
+	// new_generation keeps the elites, best first, at the front of the population
+	auto num_migrants = std::min(island_settings.num_migrants, num_elites(static_cast<uint32_t>(settings.game.num_agents)));
+
+	// Queue idx_island carries migrants from island idx_island to the next one in the ring
+	for (uint32_t idx_island = 0; idx_island < num_islands; idx_island++) {
+		queues.push_back(std::make_unique<Migration_queue>(4 * num_migrants, settings.brain.num_weights));
+	}
+
+	for (uint32_t idx_island = 0; idx_island < num_islands; idx_island++) {
+		threads.emplace_back([&, idx_island]() {
+			auto& outgoing = *queues[idx_island];
+			auto& incoming = *queues[(idx_island + num_islands - 1) % num_islands];
+			auto sim = Sim_state();
+
+			sim.verbose = false;
+			init_sim_state(sim, Random::stream(seed, idx_island).next(), nullptr);
+
+			for (auto& net : sim.neural_nets) {
+				net.set_simd_level(simd_level);
+			}
+
+			auto& population = sim.genetic_algorithm->population;
+
+			for (auto idx_generation = 1; idx_generation <= num_generations; idx_generation++) {
+				while (step(sim, level)) {
+				}
+
+				auto num_steps = sim.num_physics_steps;
+
+				next_generation(sim);
+
+				auto num_immigrants = 0u;
+
+				if ((num_islands > 1) && (idx_generation % island_settings.migration_interval == 0)) {
+					for (uint32_t idx_migrant = 0; idx_migrant < num_migrants; idx_migrant++) {
+						outgoing.push(population[idx_migrant].weights);
+					}
+
+					while ((num_immigrants < population.size() - num_migrants)
+						&& incoming.pop(population[population.size() - 1 - num_immigrants].weights)) {
+						num_immigrants++;
+					}
+
+					if (num_immigrants > 0) {
+						pack_population_weights(sim);
+					}
+				}
+
+				auto lock = std::scoped_lock(mutex_log);
+				std::cout << "Island " << idx_island << " generation " << idx_generation << " (" << num_steps << " steps): best score "
+					<< sim.best_score << " (" << sim.best_score_overall << "), best level " << sim.best_level << " (" << sim.best_level_overall << ")";
+
+				if (num_immigrants > 0) {
+					std::cout << ", " << num_immigrants << " immigrants";
+				}
+
+				std::cout << std::endl;
+			}
+			});
+	}
+
+	for (auto& thread : threads) {
+		thread.join();
+	}
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <simulation.h>
+
+struct Island_settings {
+	uint32_t num_islands = 4;
+	// Generations between migrations
+	uint32_t migration_interval = 10;
+	// Genomes each island sends to its neighbour per migration, at most its elites
+	uint32_t num_migrants = 2;
+};
+
+// Lock-free single-producer/single-consumer ring of genomes travelling from one island to the next.
+//	Slots are allocated up front, so pushing and popping only copy weights.
+class Migration_queue {
+public:
+	Migration_queue(uint32_t capacity, uint32_t num_weights);
+	// False when the ring is full, the migrant is then dropped
+	bool push(std::span<const float> weights);
+	bool pop(std::span<float> weights);
+private:
+	std::vector<std::vector<float>> slots = {};
+	alignas(64) std::atomic<uint32_t> idx_read = 0;
+	alignas(64) std::atomic<uint32_t> idx_write = 0;
+};
+
+// Evolves settings.game.num_agents genomes on each of island_settings.num_islands islands, every island on
+//	its own thread with its own Sim_state. Islands form a ring: every migration_interval generations each
+//	island sends its top genomes to the next and replaces its newest children with whatever has arrived.
+//	Islands never wait for each other, so unlike a single population the same seed does not give an exactly repeatable run.
+void run_islands(const Island_settings& island_settings, uint64_t seed, int num_generations, const Level& level, Simd_level simd_level);
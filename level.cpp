@@ -0,0 +1,115 @@
+#include <algorithm>
+
+#include <level.h>
+
+Level::Level(const std::vector<Line_segment>& level_line_segments, int ceiling_half_width) : line_segments(level_line_segments) {
+	if (line_segments.empty()) {
+		return;
+	}
+
+	build_ceiling_columns(ceiling_half_width);
+
+	x_min = std::min(line_segments.front().x_start, line_segments.front().x_end);
+	x_max = std::max(line_segments.front().x_start, line_segments.front().x_end);
+
+	for (auto& line_segment : line_segments) {
+		x_min = std::min({ x_min, line_segment.x_start, line_segment.x_end });
+		x_max = std::max({ x_max, line_segment.x_start, line_segment.x_end });
+	}
+
+	auto num_columns = static_cast<size_t>(x_max - x_min + 1);
+
+	column_offsets.resize(num_columns + 1);
+
+	for (int x = x_min; x <= x_max; x++) {
+		auto idx_column_begin = entries.size();
+
+		for (size_t idx_line_segment = 0; idx_line_segment < line_segments.size(); idx_line_segment++) {
+			auto& line_segment = line_segments[idx_line_segment];
+			auto line_x_min = std::min(line_segment.x_start, line_segment.x_end);
+			auto line_x_max = std::max(line_segment.x_start, line_segment.x_end);
+
+			if ((x >= line_x_min) && (x <= line_x_max)) {
+				entries.push_back({ line_segment.y_start, static_cast<uint32_t>(idx_line_segment) });
+			}
+		}
+
+		// Stable, so equal heights keep line_segments order
+		std::stable_sort(entries.begin() + idx_column_begin, entries.end(), [](const Column_entry& a, const Column_entry& b) { return a.y > b.y; });
+		column_offsets[x - x_min + 1] = static_cast<uint32_t>(entries.size());
+	}
+}
+
+void Level::build_ceiling_columns(int ceiling_half_width) {
+	// The ceiling test holds for x_start - ceiling_half_width <= x <= x_end + ceiling_half_width
+	ceiling_x_min = line_segments.front().x_start - ceiling_half_width;
+	ceiling_x_max = line_segments.front().x_end + ceiling_half_width;
+
+	for (auto& line_segment : line_segments) {
+		ceiling_x_min = std::min(ceiling_x_min, line_segment.x_start - ceiling_half_width);
+		ceiling_x_max = std::max(ceiling_x_max, line_segment.x_end + ceiling_half_width);
+	}
+
+	auto num_columns = static_cast<size_t>(std::max(ceiling_x_max - ceiling_x_min + 1, 0));
+
+	ceiling_column_offsets.resize(num_columns + 1);
+
+	for (int x = ceiling_x_min; x <= ceiling_x_max; x++) {
+		auto idx_column_begin = ceiling_heights.size();
+
+		for (auto& line_segment : line_segments) {
+			if ((line_segment.x_start <= x + ceiling_half_width) && (line_segment.x_end >= x - ceiling_half_width)) {
+				ceiling_heights.push_back(line_segment.y_start);
+			}
+		}
+
+		std::sort(ceiling_heights.begin() + idx_column_begin, ceiling_heights.end());
+		ceiling_column_offsets[x - ceiling_x_min + 1] = static_cast<uint32_t>(ceiling_heights.size());
+	}
+}
+
+int Level::get_ceiling_distance(int x, int y, int max_distance) const {
+	if ((x < ceiling_x_min) || (x > ceiling_x_max)) {
+		return max_distance;
+	}
+
+	auto column_begin = ceiling_heights.begin() + ceiling_column_offsets[x - ceiling_x_min];
+	auto column_end = ceiling_heights.begin() + ceiling_column_offsets[x - ceiling_x_min + 1];
+	auto it = std::lower_bound(column_begin, column_end, y);
+
+	if (it == column_end) {
+		return max_distance;
+	}
+
+	return std::min(*it - y, max_distance);
+}
+
+const Level::Column_entry* Level::find_in_column(int x, int y_before, int y_after) const {
+	if ((x < x_min) || (x > x_max)) {
+		return nullptr;
+	}
+
+	auto column_begin = entries.begin() + column_offsets[x - x_min];
+	auto column_end = entries.begin() + column_offsets[x - x_min + 1];
+	// First (highest) entry below y_before
+	auto it = std::partition_point(column_begin, column_end, [y_before](const Column_entry& entry) { return entry.y >= y_before; });
+
+	if ((it == column_end) || (it->y < y_after)) {
+		return nullptr;
+	}
+
+	return &*it;
+}
+
+const Line_segment* Level::get_collision_line_segment(int x_left, int x_right, int y_before, int y_after) const {
+	auto entry_left = find_in_column(x_left, y_before, y_after);
+	auto entry_right = find_in_column(x_right, y_before, y_after);
+	auto entry = entry_left;
+
+	if (!entry || (entry_right && ((entry_right->y > entry->y)
+		|| ((entry_right->y == entry->y) && (entry_right->idx_line_segment < entry->idx_line_segment))))) {
+		entry = entry_right;
+	}
+
+	return entry ? &line_segments[entry->idx_line_segment] : nullptr;
+}
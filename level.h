@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+struct Line_segment {
+	int x_start = {};
+	int y_start = {};
+	int x_end = {};
+	int y_end = {};
+};
+
+// Static level geometry, plus lookup structures baked from it once at startup
+class Level {
+public:
+	// ceiling_half_width is the half width of the entities that get_ceiling_distance is asked about
+	Level(const std::vector<Line_segment>& level_line_segments, int ceiling_half_width);
+	// The segment an entity spanning [x_left, x_right] lands on when its bottom moves from y_before to
+	//	y_after: the highest segment with y_after <= y < y_before that contains x_left or x_right, the
+	//	first one in line_segments on ties. nullptr if there is none.
+	const Line_segment* get_collision_line_segment(int x_left, int x_right, int y_before, int y_after) const;
+
+	// Distance from y up to the lowest segment with y_start >= y whose x_start <= x + ceiling_half_width
+	//	and x_end >= x - ceiling_half_width, capped at max_distance. Segments are taken as stored, so one
+	//	running right to left only counts where its ends cross over the entity.
+	int get_ceiling_distance(int x, int y, int max_distance) const;
+
+	std::vector<Line_segment> line_segments = {};
+private:
+	struct Column_entry {
+		int y = {};
+		uint32_t idx_line_segment = {};
+	};
+
+	// Best candidate in one column, or nullptr
+	const Column_entry* find_in_column(int x, int y_before, int y_after) const;
+	void build_ceiling_columns(int ceiling_half_width);
+
+	// Every integer x column holds the segments covering it, highest first and in line_segments order on
+	//	ties. Column x is entries[column_offsets[x - x_min]] up to entries[column_offsets[x - x_min + 1]].
+	// No columns until there is geometry
+	int x_min = 0;
+	int x_max = -1;
+	std::vector<uint32_t> column_offsets = {};
+	std::vector<Column_entry> entries = {};
+	// Same layout for the ceiling query: heights of the segments an entity at x sees above it, lowest first
+	int ceiling_x_min = 0;
+	int ceiling_x_max = -1;
+	std::vector<uint32_t> ceiling_column_offsets = {};
+	std::vector<int> ceiling_heights = {};
+};
@@ -1,6 +1,10 @@
 #include <algorithm>
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
-#include <numbers>
+#include <memory>
+#include <random>
+#include <string>
 #include <vector>
 
 #include <glad/glad.h>
@@ -9,38 +13,10 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
-#include <genetic_algorithm.h>
-#include <neural_net.h>
-
-enum class Action {
-	Left,
-	Right,
-	Jump
-};
-
-struct Entity {
-	int offset_x = {};
-	int offset_y = {};
-	int width = {};
-	int height = {};
-	int v_x = {};
-	int v_y = {};
-	bool is_on_ground = false;
-	int level = 0;
-};
-
-struct Player : public Entity {
-	int score = 0;
-	bool alive = false;
-	int dead_at_step = 0;
-};
-
-struct Line_segment {
-	int x_start = {};
-	int y_start = {};
-	int x_end = {};
-	int y_end = {};
-};
+#include <profile.h>
+#include <replay.h>
+#include <sim_thread.h>
+#include <simulation.h>
 
 struct Shader_locations {
 	int offset = {};
@@ -48,430 +24,166 @@ struct Shader_locations {
 	int projection = {};
 };
 
+// Sim speed on key 2, as a multiple of physics_update_rate_hz
+constexpr float sim_speed_fast = 10.0f;
+
 struct Buffer_info {
 	GLuint vao = {};
 	GLuint vbo = {};
 	GLuint ebo = {};
+	// Per-instance data of instanced entities, and how many instances it has room for
+	GLuint vbo_instances = {};
+	size_t capacity_instances = {};
 };
 
-struct Settings {
-	struct Brain {
-		int num_inputs = 9;
-		int num_hidden = 2 * num_inputs;
-		int num_outputs = 3;
-		int num_weights = (num_inputs * num_hidden) + (num_hidden * num_outputs); // No biases for simplicity
-	};
-
-	struct Game {
-		int num_agents = 500;
-		int initial_jump_size = 6;
-		float physics_update_rate_hz = 250.0f;
-	};
-
-	struct Gui {
-		int window_width = 800 * 2;
-		int window_height = 600 * 2;
-		int square_size_pixels = 8;
-		int num_squares_x = 28;
-		int num_squares_y = 32;
-		int board_width = num_squares_x * square_size_pixels;
-		int board_height = num_squares_y * square_size_pixels;
-		float scale = 4.0f;
-	};
-
-	Brain brain = {};
-	Game game = {};
-	Gui gui = {};
+// One entity in an instanced draw. The color is normalized to [0, 1] by the vertex fetch.
+struct Instance {
+	float offset_x = {};
+	float offset_y = {};
+	uint8_t color[4] = {};
 };
 
-auto settings = Settings{ };
+// Attribute locations of the shaders below
+constexpr GLuint attribute_position = 0;
+constexpr GLuint attribute_instance_offset = 1;
+constexpr GLuint attribute_instance_color = 2;
 
+// Instanced entities take their offset and color from per-instance attributes. Everything else is drawn
+//	from a VAO without those, so they take the current attribute values set at startup: no offset, white.
 const char* vertexShaderSource = R"glsl(
     #version 330 core
     layout (location = 0) in vec2 aPos;
+    layout (location = 1) in vec2 aInstanceOffset;
+    layout (location = 2) in vec4 aInstanceColor;
     uniform vec2 offset;
+    uniform vec4 uColor;
     uniform mat4 uProjection;
+    out vec4 vColor;
 
     void main() {
-        gl_Position = uProjection * vec4(aPos + offset, 0.0, 1.0);
+        gl_Position = uProjection * vec4(aPos + offset + aInstanceOffset, 0.0, 1.0);
+        vColor = uColor * aInstanceColor;
     }
 )glsl";
 
 const char* fragmentShaderSource = R"glsl(
     #version 330 core
+    in vec4 vColor;
     out vec4 FragColor;
-    uniform vec4 uColor;
 
     void main() {
-        FragColor = uColor;
+        FragColor = vColor;
     }
 )glsl";
 
-void process_input(GLFWwindow* window) {
-	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
-		glfwSetWindowShouldClose(window, true);
-	}
+// A quad drawn once per Instance, with the instance data in its own buffer
+void init_instanced_quad(Buffer_info& buffer_info, const std::vector<float>& vertices, const std::vector<int>& indices) {
+	glGenVertexArrays(1, &buffer_info.vao);
+	glGenBuffers(1, &buffer_info.vbo);
+	glGenBuffers(1, &buffer_info.ebo);
+	glGenBuffers(1, &buffer_info.vbo_instances);
+	glBindVertexArray(buffer_info.vao);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer_info.vbo);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(vertices[0]), vertices.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer_info.ebo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(indices[0]), indices.data(), GL_STATIC_DRAW);
+	glVertexAttribPointer(attribute_position, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+	glEnableVertexAttribArray(attribute_position);
+
+	glBindBuffer(GL_ARRAY_BUFFER, buffer_info.vbo_instances);
+	glVertexAttribPointer(attribute_instance_offset, 2, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)offsetof(Instance, offset_x));
+	glVertexAttribDivisor(attribute_instance_offset, 1);
+	glEnableVertexAttribArray(attribute_instance_offset);
+	glVertexAttribPointer(attribute_instance_color, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Instance), (void*)offsetof(Instance, color));
+	glVertexAttribDivisor(attribute_instance_color, 1);
+	glEnableVertexAttribArray(attribute_instance_color);
 }
 
-template <typename T>
-class Circular_buffer {
-public:
-	Circular_buffer(uint32_t max_count) : max_count(max_count) {
-		elements.reserve(max_count);
-	}
-
-	void add_element(const T& element) {
-		if (elements.size() == max_count) {
-			elements[idx_cur] = element;
-		}
-		else {
-			elements.push_back(element);
-		}
-
-		idx_cur = (idx_cur + 1) % max_count;
-	}
-
-	void clear() {
-		elements.clear();
-		idx_cur = 0;
+// All instances in one draw call. The buffer is orphaned before every upload, so the driver hands out fresh
+//	storage instead of waiting for the previous frame's draw to finish reading it.
+void draw_instances(Buffer_info& buffer_info, const std::vector<Instance>& instances) {
+	if (instances.empty()) {
+		return;
 	}
 
-	std::vector<Entity> elements = {};
-private:
-	uint32_t max_count = {};
-	uint32_t idx_cur = 0;
-};
-
-void physics(int num_physics_steps, std::vector<Line_segment>& line_segments, std::vector<Player>& players, std::vector<Entity>& barrels) {
-	auto max_x = 14 * 8;
-
-	auto get_collision_line_segment = [&line_segments](Entity& entity, int y_before, int y_after) {
-		auto x_left = entity.offset_x - entity.width / 2;
-		auto x_right = entity.offset_x + entity.width / 2;
-		Line_segment* cur_line_segment = nullptr;
-
-		for (auto& line_segment : line_segments) {
-			auto line_x_min = std::min(line_segment.x_start, line_segment.x_end);
-			auto line_x_max = std::max(line_segment.x_start, line_segment.x_end);
-			auto has_overlap_x_left = (std::clamp(x_left, line_x_min, line_x_max) == x_left);
-			auto has_overlap_x_right = (std::clamp(x_right, line_x_min, line_x_max) == x_right);
-			auto has_overlap_x = has_overlap_x_left || has_overlap_x_right;
-
-			if (!has_overlap_x) {
-				continue;
-			}
-
-			// Assume start/end y is same value
-			auto line_y = line_segment.y_start;
-
-			if ((y_before > line_y) && (y_after <= line_y)) {
-				if (cur_line_segment == nullptr) {
-					cur_line_segment = &line_segment;
-				}
-				else if (cur_line_segment->y_start < line_y) {
-					cur_line_segment = &line_segment;
-				}
-			}
-		}
-
-		return cur_line_segment;
-		};
-
-	auto apply_gravity = [&get_collision_line_segment](Entity& entity) {
-		Line_segment* line_segment_collision = nullptr;
-
-		if (!entity.is_on_ground) {
-			if (entity.v_y < 0) {
-				line_segment_collision = get_collision_line_segment(entity, entity.offset_y - entity.height / 2 + 2, entity.offset_y - entity.height / 2 + entity.v_y);
-			}
-		}
-		else {
-			line_segment_collision = get_collision_line_segment(entity, entity.offset_y - entity.height / 2 + 2, entity.offset_y - entity.height / 2 - 1);
-		}
-
-		if (line_segment_collision) {
-			entity.offset_y = line_segment_collision->y_start + entity.height / 2;
-			entity.is_on_ground = true;
-			entity.v_y = 0;
-			entity.level = 0;
-
-			if (entity.offset_y >= -92) {
-				entity.level = 1;
-			}
-			if (entity.offset_y >= -57) {
-				entity.level = 2;
-			}
-			if (entity.offset_y >= -26) {
-				entity.level = 3;
-			}
-			if (entity.offset_y >= 6) {
-				entity.level = 4;
-			}
-			if (entity.offset_y >= 39) {
-				entity.level = 5;
-			}
-		}
-		else {
-			if (entity.is_on_ground) {
-				entity.v_y = -1;
-				entity.is_on_ground = false;
-			}
-		}
-
-		if (!entity.is_on_ground) {
-			entity.offset_y += entity.v_y;
-			entity.v_y -= 1;
-		}
-		};
-
-	struct Hit_info {
-		bool hit_wall = false;
-	};
+	glBindBuffer(GL_ARRAY_BUFFER, buffer_info.vbo_instances);
+	buffer_info.capacity_instances = std::max(buffer_info.capacity_instances, instances.size());
+	glBufferData(GL_ARRAY_BUFFER, buffer_info.capacity_instances * sizeof(Instance), nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(Instance), instances.data());
+	glBindVertexArray(buffer_info.vao);
+	glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0, (GLsizei)instances.size());
+}
 
-	auto apply_movement = [&max_x](Entity& entity) {
-		auto offset_x_before = entity.offset_x;
-		entity.offset_x = std::clamp(entity.offset_x + entity.v_x, -max_x, max_x);
-		auto hit_wall = (entity.offset_x == offset_x_before) && (entity.v_x != 0);
+Instance make_instance(int offset_x, int offset_y, float r, float g, float b) {
+	auto instance = Instance();
 
-		return Hit_info{ hit_wall };
-		};
+	instance.offset_x = (float)offset_x;
+	instance.offset_y = (float)offset_y;
+	instance.color[0] = (uint8_t)(r * 255.0f);
+	instance.color[1] = (uint8_t)(g * 255.0f);
+	instance.color[2] = (uint8_t)(b * 255.0f);
+	instance.color[3] = 255;
 
-	for (auto& player : players) {
-		if (!player.alive) {
-			continue;
-		}
-		apply_gravity(player);
-		apply_movement(player);
-	}
-
-	for (auto& barrel : barrels) {
-		apply_gravity(barrel);
-		auto hit_info = apply_movement(barrel);
-		if (hit_info.hit_wall) {
-			barrel.v_x = -barrel.v_x;
-		}
-	}
-
-	for (auto& player : players) {
-		if (!player.alive) {
-			continue;
-		}
-		if (!player.is_on_ground) {
-			// TODO: Think we should always be alive if we are in the air?
-			continue;
-		}
-		for (auto& barrel : barrels) {
-			auto ok1 = player.offset_x <= (barrel.offset_x + barrel.width / 2);
-			auto ok2 = player.offset_x >= (barrel.offset_x - barrel.width / 2);
-			auto ok3 = player.offset_y <= (barrel.offset_y + barrel.height / 2);
-			auto ok4 = player.offset_y >= (barrel.offset_y - barrel.height / 2);
-			if (ok1 && ok2 && ok3 && ok4) {
-				player.alive = false;
-				player.dead_at_step = num_physics_steps;
-				// TODO: We assume the last line segment is the one at the bottom of the board.
-				//	Should be an alright assumption
-				player.score = player.offset_y - line_segments.back().y_end;
-				break;
-			}
-		}
-	}
+	return instance;
 }
 
-void jump(Player& player) {
-	if (!player.is_on_ground) {
-		return;
+void process_input(GLFWwindow* window) {
+	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
+		glfwSetWindowShouldClose(window, true);
 	}
-
-	player.v_y = settings.game.initial_jump_size;
-	player.is_on_ground = false;
 }
 
-void move_left(Player& player) {
-	player.v_x = -1;
-}
-
-void move_right(Player& player) {
-	player.v_x = 1;
-}
+// Keys held for the human player, as Sim_thread::set_human_input wants them. GLFW input can only be read
+//	on the main thread, so the sim thread gets it from here.
+uint32_t read_human_input(GLFWwindow* window) {
+	auto action_bits = 0u;
 
-void brain_run_human(GLFWwindow* window, Player& player) {
 	if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS) {
-		move_left(player);
+		action_bits |= 1u << static_cast<uint32_t>(Action::Left);
 	}
 
 	if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS) {
-		move_right(player);
+		action_bits |= 1u << static_cast<uint32_t>(Action::Right);
 	}
 
 	if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS) {
-		jump(player);
+		action_bits |= 1u << static_cast<uint32_t>(Action::Jump);
 	}
-}
-
-std::unique_ptr<Genetic_algorithm> genetic_algorithm = nullptr;
-std::unique_ptr<Neural_net> neural_net = nullptr;
-
-void brain_run_machine(std::vector<Line_segment>& line_segments, std::vector<Player>& players, std::vector<Entity>& barrels) {
-	for (auto idx_player = 0; idx_player < players.size(); idx_player++) {
-		auto& player = players[idx_player];
-
-		auto distance_ceiling = 100.0f;
-		auto level = (float)player.level;
-
-		for (auto& line_segment : line_segments) {
-			if (line_segment.y_start < player.offset_y) {
-				continue;
-			}
-			auto ok1 = (line_segment.x_start <= (player.offset_x + player.width / 2));
-			auto ok2 = (line_segment.x_end >= (player.offset_x - player.width / 2));
-			if (ok1 && ok2) {
-				auto cur_distance_ceiling = (float)(line_segment.y_start - player.offset_y);
-				if (cur_distance_ceiling < distance_ceiling) {
-					distance_ceiling = cur_distance_ceiling;
-				}
-			}
-		}
-
-		struct Barrel_distance {
-			Entity* barrel = nullptr;
-			float angle = 0.0f;
-			float distance = 0.0f;
-		};
-
-		auto barrel_distances = std::vector<Barrel_distance>(2);
-
-		for (auto& barrel_distance : barrel_distances) {
-			barrel_distance.distance = 100.0f;
-		}
-
-		auto idx_cur_worst = 0;
-
-		for (auto& barrel : barrels) {
-			auto distance = std::hypotf((float)barrel.offset_x - player.offset_x, (float)barrel.offset_y - player.offset_y);
-
-			if (distance < barrel_distances[idx_cur_worst].distance) {
-				auto angle = std::atan2f((float)barrel.offset_y - player.offset_y, (float)barrel.offset_x - player.offset_x);
-				auto new_barrel_distance = Barrel_distance();
-				new_barrel_distance.angle = angle;
-				new_barrel_distance.distance = distance;
-				new_barrel_distance.barrel = &barrel;
-				barrel_distances[idx_cur_worst] = new_barrel_distance;
-			}
-		}
-
-		auto is_on_ground = (player.is_on_ground ? 1.0f : 0.0f);
-
-		// Normalizing
-		auto player_offset_x = player.offset_x / 100.0f;
-		auto player_offset_y = player.offset_y / 100.0f;
-		level /= 5;
-
-		for (auto& barrel_distance : barrel_distances) {
-			barrel_distance.angle /= std::numbers::pi_v<float>;
-			barrel_distance.distance /= 100.0f;
-		}
 
-		distance_ceiling /= 100.0f;
-
-		auto inputs = std::vector<float>{
-			is_on_ground,
-			player_offset_x,
-			player_offset_y,
-			level,
-			barrel_distances[0].distance,
-			barrel_distances[0].angle,
-			barrel_distances[1].distance,
-			barrel_distances[1].angle,
-			distance_ceiling
-		};
-
-		auto idx_best_output = uint32_t{};
-		auto& genome = genetic_algorithm->population[idx_player];
-
-		if (!neural_net->forward(inputs, genome.weights, idx_best_output)) {
-			std::cout << "Could not feed-forward\n";
-		}
-
-		auto action = static_cast<Action>(idx_best_output);
-
-		switch (action) {
-		case Action::Jump: jump(player); break;
-		case Action::Left: move_left(player); break;
-		case Action::Right: move_right(player); break;
-		}
-	}
+	return action_bits;
 }
 
-void brain_run(GLFWwindow* window, std::vector<Line_segment>& line_segments, std::vector<Player>& players, std::vector<Entity>& barrels, bool is_human) {
-	if (players.empty()) {
-		return;
-	}
-
-	for (auto& player : players) {
-		player.v_x = 0;
+// Speed multiplier picked with keys 1, 2 and 3 while training, or the current one if none is pressed
+float read_sim_speed(GLFWwindow* window, float speed) {
+	if (glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS) {
+		return 1.0f;
 	}
 
-	if (is_human) {
-		brain_run_human(window, players[0]);
+	if (glfwGetKey(window, GLFW_KEY_2) == GLFW_PRESS) {
+		return sim_speed_fast;
 	}
-	else {
-		brain_run_machine(line_segments, players, barrels);
-	}
-}
 
-void brain_update(const std::vector<Player>& players) {
-	static auto best_score_overall = 0.0f;
-	static auto best_level_overall = 0;
-	auto best_level = 0;
-	auto best_score = 0.0f;
-	auto num_agents = players.size();
-
-	for (auto idx_agent = 0; idx_agent < num_agents; idx_agent++) {
-		genetic_algorithm->population[idx_agent].fitness = (float)players[idx_agent].score;
-		best_level = std::max(best_level, players[idx_agent].level);
-		best_score = std::max(best_score, (float)players[idx_agent].score);
+	if (glfwGetKey(window, GLFW_KEY_3) == GLFW_PRESS) {
+		return sim_speed_unlimited;
 	}
 
-	best_level_overall = std::max(best_level_overall, best_level);
-	best_score_overall = std::max(best_score_overall, best_score);
-	std::cout << "Best score in generation (best total): " << best_score << " (" << best_score_overall << ")\n";
-	std::cout << "Best level in generation (best total): " << best_level << " (" << best_level_overall << ")\n";
-
-	genetic_algorithm->new_generation();
+	return speed;
 }
 
-void spawn_barrel(Circular_buffer<Entity>& barrel_buffer) {
-	auto barrel = Entity();
-
-	barrel.is_on_ground = false;
-	barrel.height = 8;
-	barrel.width = 8;
-	barrel.offset_y = 100;
-	barrel.offset_x = 0;
-	barrel.v_x = 2 * (2 * (std::rand() % 2) - 1);
+// Steps to seek by in replay playback, set from the arrow keys
+int replay_seek_steps = 0;
 
-	barrel_buffer.add_element(barrel);
-}
-
-void game_logics(int num_physics_steps, Circular_buffer<Entity>& barrel_buffer) {
-	if (num_physics_steps % 100 == 0) {
-		spawn_barrel(barrel_buffer);
+void replay_key_callback(GLFWwindow*, int key, int, int action, int) {
+	if (action != GLFW_PRESS) {
+		return;
 	}
-}
-
-void init_players(std::vector<Player>& players, uint32_t num_agents, bool is_human, int player_width, int player_height) {
-	auto num_players = is_human ? 1 : num_agents;
 
-	players.resize(num_agents);
+	if (key == GLFW_KEY_RIGHT) {
+		replay_seek_steps += replay_keyframe_interval;
+	}
 
-	for (uint32_t idx_player = 0; idx_player < num_players; idx_player++) {
-		auto player = Player();
-		player.offset_x = -50;
-		player.offset_y = -100;
-		player.width = player_width;
-		player.height = player_height;
-		player.alive = true;
-		players[idx_player] = player;
+	if (key == GLFW_KEY_LEFT) {
+		replay_seek_steps -= replay_keyframe_interval;
 	}
 }
 
@@ -491,8 +203,10 @@ void mouse_button_callback(GLFWwindow* window, int button, int action, int) {
 	}
 }
 
-void render(int num_physics_steps, const std::vector<Player>& players, const std::vector<Entity>& barrels, const std::vector<Line_segment>& line_segments, const Shader_locations& shader_locations,
-	const Buffer_info& buffer_info_background, const Buffer_info& buffer_info_player, const Buffer_info& buffer_info_barrel, const Buffer_info& buffer_info_lines) {
+void render(int num_physics_steps, const Player_store& players, const Entity_store& barrels, const std::vector<Line_segment>& line_segments, const Shader_locations& shader_locations,
+	const Buffer_info& buffer_info_background, Buffer_info& buffer_info_player, Buffer_info& buffer_info_barrel, const Buffer_info& buffer_info_lines) {
+	DONKEY_PROFILE_SCOPE(Render);
+
 	// Background
 	glClearColor(0.1f, 0.1f, 0.15f, 1.0f);
 	glClear(GL_COLOR_BUFFER_BIT);
@@ -506,16 +220,23 @@ void render(int num_physics_steps, const std::vector<Player>& players, const std
 	// Lines
 	glUniform4f(shader_locations.color, 240.0f / 255, 82.0f / 255, 156.0f / 255, 1.0f);
 	glBindVertexArray(buffer_info_lines.vao);
-	glDrawArrays(GL_LINES, 0, (GLsizei)line_segments.size() * sizeof(line_segments[0]));
+	glDrawArrays(GL_LINES, 0, (GLsizei)line_segments.size() * 2);
+
+	// Entities are colored by their instances alone
+	glUniform4f(shader_locations.color, 1.0f, 1.0f, 1.0f, 1.0f);
+
+	// Reused every frame, so only growing the population allocates
+	auto static instances = std::vector<Instance>();
 
 	// Barrels
-	for (auto& barrel : barrels) {
-		glUniform2f(shader_locations.offset, (float)barrel.offset_x, (float)barrel.offset_y);
-		glUniform4f(shader_locations.color, 0.7f, 0.4f, 0.4f, 1.0f);
-		glBindVertexArray(buffer_info_barrel.vao);
-		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+	instances.clear();
+
+	for (size_t idx_barrel = 0; idx_barrel < barrels.size(); idx_barrel++) {
+		instances.push_back(make_instance(barrels.offset_x[idx_barrel], barrels.offset_y[idx_barrel], 0.7f, 0.4f, 0.4f));
 	}
 
+	draw_instances(buffer_info_barrel, instances);
+
 	// Players
 	auto static colors = std::vector<glm::vec3>{
 		{0.2f, 0.4f, 1.0f},
@@ -526,26 +247,26 @@ void render(int num_physics_steps, const std::vector<Player>& players, const std
 		{0.5f, 0.7f, 0.2f},
 	};
 
-	for (auto& player : players) {
-		if (!player.alive && ((num_physics_steps - player.dead_at_step) > 500)) {
+	instances.clear();
+
+	for (size_t idx_player = 0; idx_player < players.size(); idx_player++) {
+		if (!players.alive[idx_player] && ((num_physics_steps - players.dead_at_step[idx_player]) > 500)) {
 			continue;
 		}
 
-		glUniform2f(shader_locations.offset, (float)player.offset_x, (float)player.offset_y);
-
-		auto color = colors[player.level];
+		auto color = colors[players.level[idx_player]];
 
-		if (!player.alive) {
+		if (!players.alive[idx_player]) {
 			color *= 0.5;
 		}
 
-		glUniform4f(shader_locations.color, color.r, color.g, color.b, 1.0f);
-		glBindVertexArray(buffer_info_player.vao);
-		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+		instances.push_back(make_instance(players.offset_x[idx_player], players.offset_y[idx_player], color.r, color.g, color.b));
 	}
+
+	draw_instances(buffer_info_player, instances);
 }
 
-int main() {
+int main(int argc, char** argv) {
 	glfwInit();
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
@@ -581,11 +302,6 @@ int main() {
 	glDeleteShader(fragmentShader);
 
 	auto is_human = false;
-	auto players = std::vector<Player>();
-	auto player_width = 8;
-	auto player_height = 8;
-
-	init_players(players, settings.game.num_agents, is_human, player_width, player_height);
 
 	auto vertices_entity_8x8 = std::vector<float>{
 		-player_width / 2.0f, -player_height / 2.0f,
@@ -601,29 +317,11 @@ int main() {
 
 	auto buffer_info_player = Buffer_info{};
 
-	glGenVertexArrays(1, &buffer_info_player.vao);
-	glGenBuffers(1, &buffer_info_player.vbo);
-	glGenBuffers(1, &buffer_info_player.ebo);
-	glBindVertexArray(buffer_info_player.vao);
-	glBindBuffer(GL_ARRAY_BUFFER, buffer_info_player.vbo);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices_entity_8x8), vertices_entity_8x8.data(), GL_STATIC_DRAW);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer_info_player.ebo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices_entity_8x8), indices_entity_8x8.data(), GL_STATIC_DRAW);
-	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(0);
+	init_instanced_quad(buffer_info_player, vertices_entity_8x8, indices_entity_8x8);
 
 	auto buffer_info_barrel = Buffer_info{};
 
-	glGenVertexArrays(1, &buffer_info_barrel.vao);
-	glGenBuffers(1, &buffer_info_barrel.vbo);
-	glGenBuffers(1, &buffer_info_barrel.ebo);
-	glBindVertexArray(buffer_info_barrel.vao);
-	glBindBuffer(GL_ARRAY_BUFFER, buffer_info_barrel.vbo);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices_entity_8x8), vertices_entity_8x8.data(), GL_STATIC_DRAW);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer_info_barrel.ebo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices_entity_8x8), indices_entity_8x8.data(), GL_STATIC_DRAW);
-	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(0);
+	init_instanced_quad(buffer_info_barrel, vertices_entity_8x8, indices_entity_8x8);
 
 	auto square_size_pixels = 8;
 	auto num_squares_x = 28;
@@ -657,38 +355,8 @@ int main() {
 	glEnableVertexAttribArray(0);
 
 	auto buffer_info_lines = Buffer_info();
-	auto line_segments = std::vector<Line_segment>();
-
-	line_segments.push_back({
-		-3 * 8, 9 * 8,
-		3 * 8, 9 * 8 });
-
-	line_segments.push_back({
-		-(num_squares_x / 2) * 8, 5 * 8 + 4,
-		4 * 8, 5 * 8 + 4 });
-
-	auto generate_line_vertices = [&line_segments](uint32_t num_blocks, int x_offset, int y_offset, int x_factor) {
-		for (auto idx_block = 0; idx_block < (int)num_blocks; idx_block++) {
-			int pix_x_start = x_offset + 8 * (x_factor * 2 * idx_block);
-			int pix_x_end = x_offset + 8 * (x_factor * 2 * (idx_block + 1));
-			int pix_y_start = y_offset - idx_block;
-			int pix_y_end = pix_y_start;
-			line_segments.push_back({
-				pix_x_start, pix_y_start,
-				pix_x_end, pix_y_end });
-		}
-		};
-
-	generate_line_vertices(4, 4 * 8, 5 * 8 + 3, 1);
-	generate_line_vertices(13, 8 * num_squares_x / 2, 8 * 2 + 3, -1);
-	generate_line_vertices(13, -8 * num_squares_x / 2, -8 * 1 - 6, 1);
-	generate_line_vertices(13, 8 * num_squares_x / 2, -8 * 5 - 6, -1);
-	generate_line_vertices(13, -8 * num_squares_x / 2, -8 * 10, 1);
-	generate_line_vertices(7, 8 * num_squares_x / 2, -8 * 14 - 2, -1);
-
-	line_segments.push_back({
-		(-num_squares_x / 2) * 8, -8 * 15,
-		0, -8 * 15 });
+	auto level = Level(generate_level(num_squares_x), player_width / 2);
+	auto& line_segments = level.line_segments;
 
 	glGenVertexArrays(1, &buffer_info_lines.vao);
 	glGenBuffers(1, &buffer_info_lines.vbo);
@@ -706,6 +374,10 @@ int main() {
 	shader_locations.color = glGetUniformLocation(shaderProgram, "uColor");
 	shader_locations.projection = glGetUniformLocation(shaderProgram, "uProjection");
 
+	// What the non-instanced VAOs read for the instance attributes they do not enable
+	glVertexAttrib4f(attribute_instance_offset, 0.0f, 0.0f, 0.0f, 1.0f);
+	glVertexAttrib4f(attribute_instance_color, 1.0f, 1.0f, 1.0f, 1.0f);
+
 	auto scale = 4.0f;
 
 	auto projection = (glm::mat4)glm::ortho(
@@ -720,85 +392,83 @@ int main() {
 
 	auto physics_update_rate_s = 1 / settings.game.physics_update_rate_hz;
 	auto time_last_physics = glfwGetTime();
-	auto num_physics_steps = 0;
 	auto time_last_fps = glfwGetTime();
 	auto num_frames_since_last_update = 0;
-	auto pos_previous_x = std::vector<int>(settings.game.num_agents);
-	auto pos_previous_y = std::vector<int>(settings.game.num_agents);
-	auto last_clear_physics_step = 0;
-	auto last_clear_no_move = 0;
-
-	for (auto idx_player = 0; idx_player < players.size(); idx_player++) {
-		auto& player = players[idx_player];
-		pos_previous_x[idx_player] = player.offset_x;
-		pos_previous_y[idx_player] = player.offset_y;
-	}
+	auto sim = Sim_state();
+
+	settings.game.seed = std::random_device()();
+	std::cout << "Seed: " << settings.game.seed << std::endl;
+	init_sim_state(sim, settings.game.seed, nullptr, is_human);
+
+	// donkey --replay PATH plays a recording from donkey_headless --record instead of training.
+	//	Left and right arrows seek, and it starts over when it ends.
+	auto replay_player = std::unique_ptr<Replay_player>();
+
+	if ((argc == 3) && (std::string(argv[1]) == "--replay")) {
+		replay_player = std::make_unique<Replay_player>();
+
+		if (!replay_player->load(argv[2], level)) {
+			glfwTerminate();
+			return -1;
+		}
 
-	neural_net = std::make_unique<Neural_net>(settings.brain.num_inputs, settings.brain.num_hidden, settings.brain.num_outputs);
-	genetic_algorithm = std::make_unique<Genetic_algorithm>(settings.game.num_agents, settings.brain.num_weights);
-	auto barrel_buffer = Circular_buffer<Entity>(50);
-	auto generation = 1;
+		glfwSetKeyCallback(window, replay_key_callback);
+	}
 
-	while (!glfwWindowShouldClose(window)) {
+	while (replay_player && !glfwWindowShouldClose(window)) {
 		process_input(window);
 		auto cur_time = glfwGetTime();
 
-		while ((cur_time - time_last_physics) > physics_update_rate_s) {
-			game_logics(num_physics_steps, barrel_buffer);
-			brain_run(window, line_segments, players, barrel_buffer.elements, is_human);
-			physics(num_physics_steps, line_segments, players, barrel_buffer.elements);
-			time_last_physics += physics_update_rate_s;
-			num_physics_steps++;
+		if (replay_seek_steps != 0) {
+			replay_player->seek(level, replay_player->state().num_physics_steps + replay_seek_steps);
+			replay_seek_steps = 0;
 		}
 
-		// Kill of long-running agents that does not move
-		if (!is_human && (num_physics_steps - last_clear_physics_step > 2000)) {
-			auto min_level = num_physics_steps / 2000;
-			std::cout << "Killing of agents below level " << min_level << std::endl;
-
-			for (auto& player : players) {
-				if (player.level < min_level) {
-					player.alive = false;
-				}
+		while ((cur_time - time_last_physics) > physics_update_rate_s) {
+			if (!replay_player->step(level)) {
+				replay_player->seek(level, 0);
 			}
 
-			last_clear_physics_step = min_level * 2000;
+			time_last_physics += physics_update_rate_s;
 		}
 
-		// Kill players that do not move. Similar to above, more aggressive
-		if (!is_human && (num_physics_steps - last_clear_no_move > 200)) {
-			for (auto idx_player = 0; idx_player < players.size(); idx_player++) {
-				auto& player = players[idx_player];
-				auto prev_x = pos_previous_x.data()[idx_player];
-				auto prev_y = pos_previous_y.data()[idx_player];
+		auto& replay_state = replay_player->state();
 
-				if (std::hypotf((float)player.offset_x - prev_x, (float)player.offset_y - prev_y) < 10.0f) {
-					player.alive = false;
-				}
+		render(replay_state.num_physics_steps, replay_state.players, replay_state.barrel_buffer.elements, line_segments, shader_locations, buffer_info_background, buffer_info_player, buffer_info_barrel, buffer_info_lines);
+		glfwSwapBuffers(window);
 
-				pos_previous_x.data()[idx_player] = player.offset_x;
-				pos_previous_y.data()[idx_player] = player.offset_y;
-			}
+		glfwPollEvents();
+	}
 
-			last_clear_no_move = 200 * (num_physics_steps / 200);
-		}
+	// Training steps on its own thread, so rendering and vsync never hold it back. Keys 1, 2 and 3 run it
+	//	at 1x, sim_speed_fast and unlimited speed, while the window draws the newest snapshot.
+	auto sim_thread = std::unique_ptr<Sim_thread>();
+	auto sim_speed = 1.0f;
 
-		auto num_alive = 0;
+	if (!replay_player) {
+		sim_thread = std::make_unique<Sim_thread>(sim, level, sim_speed);
+	}
 
-		for (auto& player : players) {
-			if (player.alive) {
-				num_alive++;
-			}
+#ifdef DONKEY_PROFILE
+	// Profiling builds report every generation played in the window to the working directory
+	if (sim_thread && !sim_thread->open_profile("donkey_profile.csv")) {
+		std::cerr << "Could not write donkey_profile.csv\n";
+	}
+#endif
+
+	while (sim_thread && !glfwWindowShouldClose(window)) {
+		process_input(window);
+		auto cur_time = glfwGetTime();
+		auto new_sim_speed = read_sim_speed(window, sim_speed);
+
+		if (new_sim_speed != sim_speed) {
+			sim_speed = new_sim_speed;
+			sim_thread->set_speed(sim_speed);
+			std::cout << "Sim speed: " << ((sim_speed == sim_speed_unlimited) ? std::string("unlimited") : std::to_string((int)sim_speed) + "x") << std::endl;
 		}
 
-		// Reset
-		if (num_alive == 0) {
-			std::cout << "===\nDone with generation " << generation++ << std::endl;
-			brain_update(players);
-			init_players(players, settings.game.num_agents, is_human, player_width, player_height);
-			num_physics_steps = 0;
-			barrel_buffer.clear();
-			std::cout << "===\n";
+		if (is_human) {
+			sim_thread->set_human_input(read_human_input(window));
 		}
 
 		// FPS
@@ -806,12 +476,14 @@ int main() {
 		num_frames_since_last_update++;
 
 		if (time_since_last_fps > 1.0) {
-			std::cout << "FPS / frame rate: " << num_frames_since_last_update / time_since_last_fps << " / " << 100 * time_since_last_fps / num_frames_since_last_update << "ms" << std::endl;
+			std::cout << "FPS / frame rate: " << num_frames_since_last_update / time_since_last_fps << " / " << 1000 * time_since_last_fps / num_frames_since_last_update << "ms" << std::endl;
 			time_last_fps = cur_time;
 			num_frames_since_last_update = 0;
 		}
 
-		render(num_physics_steps, players, barrel_buffer.elements, line_segments, shader_locations, buffer_info_background, buffer_info_player, buffer_info_barrel, buffer_info_lines);
+		auto& snapshot = sim_thread->latest_snapshot();
+
+		render(snapshot.num_physics_steps, snapshot.players, snapshot.barrels, line_segments, shader_locations, buffer_info_background, buffer_info_player, buffer_info_barrel, buffer_info_lines);
 		glfwSwapBuffers(window);
 
 		glfwPollEvents();
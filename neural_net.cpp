@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cmath>
 
 #include <neural_net.h>
@@ -13,9 +14,10 @@ Neural_net::Neural_net(uint32_t num_inputs, uint32_t num_hidden, uint32_t num_ou
 	}
 
 	num_expected_weights = (num_inputs * num_hidden) + (num_hidden * num_outputs);
+	simd_level = detect_simd_level();
 }
 
-bool Neural_net::forward(const std::vector<float>& vector_inputs, const std::vector<float>& vector_weights, uint32_t& idx_best_output) {
+bool Neural_net::forward(const std::vector<float>& vector_inputs, std::span<const float> vector_weights, uint32_t& idx_best_output) {
 	if (vector_inputs.size() != num_inputs) {
 		return false;
 	}
@@ -29,12 +31,21 @@ bool Neural_net::forward(const std::vector<float>& vector_inputs, const std::vec
 	auto inputs = vector_inputs.data();
 	auto weights = vector_weights.data();
 
+	// Input-major so the weights are read contiguously. Each hidden value still sums its inputs in order.
 	for (uint32_t idx_hidden = 0; idx_hidden < num_hidden; ++idx_hidden) {
 		hidden[idx_hidden] = 0.0f;
-		for (uint32_t idx_input = 0; idx_input < num_inputs; ++idx_input) {
-			hidden[idx_hidden] += inputs[idx_input] * weights[idx_input * num_hidden + idx_hidden];
+	}
+
+	for (uint32_t idx_input = 0; idx_input < num_inputs; ++idx_input) {
+		auto input = inputs[idx_input];
+		auto weight = weights + idx_input * num_hidden;
+
+		for (uint32_t idx_hidden = 0; idx_hidden < num_hidden; ++idx_hidden) {
+			hidden[idx_hidden] += input * weight[idx_hidden];
 		}
+	}
 
+	for (uint32_t idx_hidden = 0; idx_hidden < num_hidden; ++idx_hidden) {
 		hidden[idx_hidden] = std::tanh(hidden[idx_hidden]);
 	}
 
@@ -51,4 +62,229 @@ bool Neural_net::forward(const std::vector<float>& vector_inputs, const std::vec
 	idx_best_output = static_cast<uint32_t>(std::distance(vector_outputs.begin(), best_output_val));
 
 	return true;
-}
\ No newline at end of file
+}
+
+namespace {
+	template <typename T>
+	void gather_lanes(const std::vector<T>& from, uint32_t num_from, std::span<const uint32_t> idx_lanes, uint32_t num_weights, std::vector<T>& to) {
+		auto num_to = idx_lanes.size();
+
+		to.resize(num_to * num_weights);
+
+		for (uint32_t idx_weight = 0; idx_weight < num_weights; idx_weight++) {
+			auto row_from = from.data() + static_cast<size_t>(idx_weight) * num_from;
+			auto row_to = to.data() + idx_weight * num_to;
+
+			for (size_t idx_lane = 0; idx_lane < num_to; idx_lane++) {
+				row_to[idx_lane] = row_from[idx_lanes[idx_lane]];
+			}
+		}
+	}
+
+	// Weight idx of genome idx_genome as a float, the same value the vector kernels load
+	float batch_weight(const Batch_weights& batch_weights, size_t idx, uint32_t idx_genome) {
+		switch (batch_weights.precision) {
+		case Weight_precision::Fp16: return half_to_float(batch_weights.weights_fp16[idx]);
+		case Weight_precision::Int8: return (float)batch_weights.weights_int8[idx] * batch_weights.scales[idx_genome];
+		case Weight_precision::Fp32: break;
+		}
+
+		return batch_weights.weights[idx];
+	}
+}
+
+void gather_batch_genomes(const Batch_weights& batch_weights, std::span<const uint32_t> idx_genomes, Batch_weights& gathered) {
+	gathered.num_genomes = static_cast<uint32_t>(idx_genomes.size());
+	gathered.num_weights = batch_weights.num_weights;
+	gathered.precision = batch_weights.precision;
+
+	switch (batch_weights.precision) {
+	case Weight_precision::Fp32:
+		gather_lanes(batch_weights.weights, batch_weights.num_genomes, idx_genomes, batch_weights.num_weights, gathered.weights);
+		break;
+	case Weight_precision::Fp16:
+		gather_lanes(batch_weights.weights_fp16, batch_weights.num_genomes, idx_genomes, batch_weights.num_weights, gathered.weights_fp16);
+		break;
+	case Weight_precision::Int8:
+		gather_lanes(batch_weights.weights_int8, batch_weights.num_genomes, idx_genomes, batch_weights.num_weights, gathered.weights_int8);
+		gather_lanes(batch_weights.scales, batch_weights.num_genomes, idx_genomes, 1, gathered.scales);
+		break;
+	}
+}
+
+void Neural_net::init_batch_weights(Batch_weights& batch_weights, uint32_t num_genomes, Weight_precision precision) {
+	auto num_floats = static_cast<size_t>(num_genomes) * num_expected_weights;
+
+	batch_weights.num_genomes = num_genomes;
+	batch_weights.num_weights = num_expected_weights;
+	batch_weights.precision = precision;
+	batch_weights.weights.assign((precision == Weight_precision::Fp32) ? num_floats : 0, 0.0f);
+	batch_weights.weights_fp16.assign((precision == Weight_precision::Fp16) ? num_floats : 0, 0);
+	batch_weights.weights_int8.assign((precision == Weight_precision::Int8) ? num_floats : 0, 0);
+	batch_weights.scales.assign((precision == Weight_precision::Int8) ? num_genomes : 0, 0.0f);
+}
+
+bool Neural_net::set_batch_genome(Batch_weights& batch_weights, uint32_t idx_genome, std::span<const float> vector_weights) {
+	if ((vector_weights.size() != num_expected_weights) || (batch_weights.num_weights != num_expected_weights)) {
+		return false;
+	}
+
+	if (idx_genome >= batch_weights.num_genomes) {
+		return false;
+	}
+
+	auto num_genomes = static_cast<size_t>(batch_weights.num_genomes);
+
+	switch (batch_weights.precision) {
+	case Weight_precision::Fp32:
+		for (uint32_t idx_weight = 0; idx_weight < num_expected_weights; ++idx_weight) {
+			batch_weights.weights[idx_weight * num_genomes + idx_genome] = vector_weights[idx_weight];
+		}
+		break;
+	case Weight_precision::Fp16:
+		for (uint32_t idx_weight = 0; idx_weight < num_expected_weights; ++idx_weight) {
+			batch_weights.weights_fp16[idx_weight * num_genomes + idx_genome] = float_to_half(vector_weights[idx_weight]);
+		}
+		break;
+	case Weight_precision::Int8: {
+		auto max_magnitude = 0.0f;
+
+		for (auto weight : vector_weights) {
+			max_magnitude = std::max(max_magnitude, std::fabs(weight));
+		}
+
+		auto scale = max_magnitude / 127.0f;
+
+		batch_weights.scales[idx_genome] = scale;
+
+		for (uint32_t idx_weight = 0; idx_weight < num_expected_weights; ++idx_weight) {
+			auto quantized = (scale > 0.0f) ? std::clamp(std::nearbyint(vector_weights[idx_weight] / scale), -127.0f, 127.0f) : 0.0f;
+			batch_weights.weights_int8[idx_weight * num_genomes + idx_genome] = static_cast<int8_t>(quantized);
+		}
+		break;
+	}
+	}
+
+	return true;
+}
+
+bool Neural_net::set_simd_level(Simd_level new_simd_level) {
+	if (static_cast<int>(new_simd_level) > static_cast<int>(detect_simd_level())) {
+		return false;
+	}
+
+	simd_level = new_simd_level;
+
+	return true;
+}
+
+Simd_level Neural_net::get_simd_level() const {
+	return simd_level;
+}
+
+bool Neural_net::forward_batch(const float* inputs, uint32_t input_stride, const Batch_weights& batch_weights,
+	uint32_t idx_genome_begin, uint32_t idx_genome_end, uint32_t* idx_best_outputs) {
+	if (batch_weights.num_weights != num_expected_weights) {
+		return false;
+	}
+
+	if ((idx_genome_begin > idx_genome_end) || (idx_genome_end > batch_weights.num_genomes) || (idx_genome_end > input_stride)) {
+		return false;
+	}
+
+	auto batch_size = idx_genome_end - idx_genome_begin;
+	auto num_genomes = static_cast<size_t>(batch_weights.num_genomes);
+
+	// The vector kernels need room for one hidden layer per lane, 16 lanes at most
+	if (batch_hidden.size() < static_cast<size_t>(num_hidden) * std::max(batch_size, 16u)) {
+		batch_hidden.resize(static_cast<size_t>(num_hidden) * std::max(batch_size, 16u));
+	}
+
+	if (batch_outputs.size() < static_cast<size_t>(num_outputs) * batch_size) {
+		batch_outputs.resize(static_cast<size_t>(num_outputs) * batch_size);
+	}
+
+	if (simd_level != Simd_level::Scalar) {
+		auto args = Batch_kernel_args();
+
+		args.inputs = inputs;
+		args.input_stride = input_stride;
+		args.precision = batch_weights.precision;
+		args.weights = batch_weights.weights.data();
+		args.weights_fp16 = batch_weights.weights_fp16.data();
+		args.weights_int8 = batch_weights.weights_int8.data();
+		args.scales = batch_weights.scales.data();
+		args.num_genomes = batch_weights.num_genomes;
+		args.num_inputs = num_inputs;
+		args.num_hidden = num_hidden;
+		args.num_outputs = num_outputs;
+		args.idx_genome_begin = idx_genome_begin;
+		args.idx_genome_end = idx_genome_end;
+		args.idx_best_outputs = idx_best_outputs;
+		args.hidden_scratch = batch_hidden.data();
+
+		switch (simd_level) {
+		case Simd_level::Sse42: forward_batch_sse42(args); break;
+		case Simd_level::Avx2: forward_batch_avx2(args); break;
+		case Simd_level::Avx512: forward_batch_avx512(args); break;
+		case Simd_level::Scalar: break;
+		}
+
+		return true;
+	}
+
+	auto hidden = batch_hidden.data();
+	auto outputs = batch_outputs.data();
+
+	// Same summation order per genome as forward(), so results are bit-identical
+	std::fill_n(hidden, static_cast<size_t>(num_hidden) * batch_size, 0.0f);
+
+	for (uint32_t idx_input = 0; idx_input < num_inputs; ++idx_input) {
+		auto input = inputs + static_cast<size_t>(idx_input) * input_stride + idx_genome_begin;
+
+		for (uint32_t idx_hidden = 0; idx_hidden < num_hidden; ++idx_hidden) {
+			auto idx_weight = (static_cast<size_t>(idx_input) * num_hidden + idx_hidden) * num_genomes + idx_genome_begin;
+			auto hidden_row = hidden + static_cast<size_t>(idx_hidden) * batch_size;
+
+			for (uint32_t idx_batch = 0; idx_batch < batch_size; ++idx_batch) {
+				hidden_row[idx_batch] += input[idx_batch] * batch_weight(batch_weights, idx_weight + idx_batch, idx_genome_begin + idx_batch);
+			}
+		}
+	}
+
+	for (size_t idx = 0; idx < static_cast<size_t>(num_hidden) * batch_size; ++idx) {
+		hidden[idx] = std::tanh(hidden[idx]);
+	}
+
+	auto offset = num_inputs * num_hidden;
+
+	std::fill_n(outputs, static_cast<size_t>(num_outputs) * batch_size, 0.0f);
+
+	for (uint32_t idx_hidden = 0; idx_hidden < num_hidden; ++idx_hidden) {
+		auto hidden_row = hidden + static_cast<size_t>(idx_hidden) * batch_size;
+
+		for (uint32_t idx_output = 0; idx_output < num_outputs; ++idx_output) {
+			auto idx_weight = (offset + static_cast<size_t>(idx_hidden) * num_outputs + idx_output) * num_genomes + idx_genome_begin;
+			auto output_row = outputs + static_cast<size_t>(idx_output) * batch_size;
+
+			for (uint32_t idx_batch = 0; idx_batch < batch_size; ++idx_batch) {
+				output_row[idx_batch] += hidden_row[idx_batch] * batch_weight(batch_weights, idx_weight + idx_batch, idx_genome_begin + idx_batch);
+			}
+		}
+	}
+
+	// First maximum wins, like std::max_element in forward()
+	for (uint32_t idx_batch = 0; idx_batch < batch_size; ++idx_batch) {
+		auto idx_best_output = uint32_t{};
+
+		for (uint32_t idx_output = 1; idx_output < num_outputs; ++idx_output) {
+			if (outputs[idx_best_output * batch_size + idx_batch] < outputs[idx_output * batch_size + idx_batch]) {
+				idx_best_output = idx_output;
+			}
+		}
+
+		idx_best_outputs[idx_genome_begin + idx_batch] = idx_best_output;
+	}
+
+	return true;
+}
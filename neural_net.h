@@ -1,16 +1,55 @@
 #pragma once
 
+#include <cstdint>
+#include <span>
 #include <vector>
 
+#include <neural_net_simd.h>
+
+// Weights for a whole population, interleaved so that consecutive floats belong to consecutive genomes:
+//	weights[idx_weight * num_genomes + idx_genome]. A batch of genomes then reads each weight as one
+//	contiguous run, and SIMD lanes map to genomes.
+struct Batch_weights {
+	uint32_t num_genomes = {};
+	uint32_t num_weights = {};
+	// Only the vector for precision is filled, all in the same layout. Fp16 and Int8 halve and quarter the
+	//	bytes streamed per forward pass.
+	Weight_precision precision = Weight_precision::Fp32;
+	std::vector<float> weights = {};
+	std::vector<uint16_t> weights_fp16 = {};
+	std::vector<int8_t> weights_int8 = {};
+	// Int8: per genome, weight = weights_int8 * scales[idx_genome]
+	std::vector<float> scales = {};
+};
+
+// Copies genomes idx_genomes of batch_weights into consecutive lanes of gathered, same precision
+void gather_batch_genomes(const Batch_weights& batch_weights, std::span<const uint32_t> idx_genomes, Batch_weights& gathered);
+
 class Neural_net {
 public:
 	Neural_net(uint32_t num_inputs, uint32_t num_hidden, uint32_t num_outputs);
-	bool forward(const std::vector<float>& vector_inputs, const std::vector<float>& vector_weights, uint32_t& idx_best_output);
+	bool forward(const std::vector<float>& vector_inputs, std::span<const float> vector_weights, uint32_t& idx_best_output);
+	void init_batch_weights(Batch_weights& batch_weights, uint32_t num_genomes, Weight_precision precision = Weight_precision::Fp32);
+	// Converts vector_weights to batch_weights.precision
+	bool set_batch_genome(Batch_weights& batch_weights, uint32_t idx_genome, std::span<const float> vector_weights);
+	// Levels above what detect_simd_level() reports are rejected
+	bool set_simd_level(Simd_level new_simd_level);
+	Simd_level get_simd_level() const;
+	// Evaluates genomes [idx_genome_begin, idx_genome_end) in one pass. Inputs are stored per input,
+	//	inputs[idx_input * input_stride + idx_genome], and the chosen action of each genome is written
+	//	to idx_best_outputs[idx_genome]. The scalar level gives the same result as calling forward() per genome,
+	//	the vector levels use an approximate tanh (see neural_net_simd.h). Reduced precision weights are
+	//	converted to float as they are loaded.
+	bool forward_batch(const float* inputs, uint32_t input_stride, const Batch_weights& batch_weights,
+		uint32_t idx_genome_begin, uint32_t idx_genome_end, uint32_t* idx_best_outputs);
 private:
 	uint32_t num_inputs = {};
 	uint32_t num_hidden = {};
 	uint32_t num_outputs = {};
 	uint32_t num_expected_weights = {};
+	Simd_level simd_level = Simd_level::Scalar;
 	std::vector<float> vector_hidden = {};
 	std::vector<float> vector_outputs = {};
+	std::vector<float> batch_hidden = {};
+	std::vector<float> batch_outputs = {};
 };
\ No newline at end of file
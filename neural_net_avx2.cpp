@@ -0,0 +1,34 @@
+#include <immintrin.h>
+
+#include <neural_net_simd_impl.h>
+
+namespace {
+	// Plain mul + add rather than FMA, so results match the other ISAs lane for lane
+	struct Avx2_ops {
+		using Vec = __m256;
+		static constexpr uint32_t width = 8;
+
+		static Vec zero() { return _mm256_setzero_ps(); }
+		static Vec set1(float value) { return _mm256_set1_ps(value); }
+		static Vec load(const float* ptr) { return _mm256_loadu_ps(ptr); }
+		static void store(float* ptr, Vec value) { _mm256_storeu_ps(ptr, value); }
+		static Vec add(Vec a, Vec b) { return _mm256_add_ps(a, b); }
+		static Vec mul(Vec a, Vec b) { return _mm256_mul_ps(a, b); }
+		static Vec div(Vec a, Vec b) { return _mm256_div_ps(a, b); }
+		static Vec min(Vec a, Vec b) { return _mm256_min_ps(a, b); }
+		static Vec max(Vec a, Vec b) { return _mm256_max_ps(a, b); }
+		static Vec select_lt(Vec a, Vec b, Vec if_less, Vec otherwise) { return _mm256_blendv_ps(otherwise, if_less, _mm256_cmp_ps(a, b, _CMP_LT_OQ)); }
+		static void store_indices(uint32_t* ptr, Vec value) { _mm256_storeu_si256((__m256i*)ptr, _mm256_cvttps_epi32(value)); }
+		// Widened to 32 bits, a half's exponent is 112 too small; scaling fixes it and normalises denormals
+		static Vec load_fp16(const uint16_t* ptr) {
+			auto half = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)ptr));
+			auto magnitude = _mm256_mul_ps(_mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(half, _mm256_set1_epi32(0x7fff)), 13)), _mm256_set1_ps(0x1p112f));
+			return _mm256_or_ps(magnitude, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(half, _mm256_set1_epi32(0x8000)), 16)));
+		}
+		static Vec load_int8(const int8_t* ptr) { return _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i*)ptr))); }
+	};
+}
+
+void forward_batch_avx2(const Batch_kernel_args& args) {
+	forward_batch_kernel<Avx2_ops>(args);
+}
@@ -0,0 +1,29 @@
+#include <immintrin.h>
+
+#include <neural_net_simd_impl.h>
+
+namespace {
+	struct Avx512_ops {
+		using Vec = __m512;
+		static constexpr uint32_t width = 16;
+
+		static Vec zero() { return _mm512_setzero_ps(); }
+		static Vec set1(float value) { return _mm512_set1_ps(value); }
+		static Vec load(const float* ptr) { return _mm512_loadu_ps(ptr); }
+		static void store(float* ptr, Vec value) { _mm512_storeu_ps(ptr, value); }
+		static Vec add(Vec a, Vec b) { return _mm512_add_ps(a, b); }
+		static Vec mul(Vec a, Vec b) { return _mm512_mul_ps(a, b); }
+		static Vec div(Vec a, Vec b) { return _mm512_div_ps(a, b); }
+		static Vec min(Vec a, Vec b) { return _mm512_min_ps(a, b); }
+		static Vec max(Vec a, Vec b) { return _mm512_max_ps(a, b); }
+		static Vec select_lt(Vec a, Vec b, Vec if_less, Vec otherwise) { return _mm512_mask_blend_ps(_mm512_cmp_ps_mask(a, b, _CMP_LT_OQ), otherwise, if_less); }
+		static void store_indices(uint32_t* ptr, Vec value) { _mm512_storeu_si512(ptr, _mm512_cvttps_epi32(value)); }
+		// vcvtph2ps is part of AVX-512F and exact, so it matches the bit arithmetic of the other ISAs
+		static Vec load_fp16(const uint16_t* ptr) { return _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i*)ptr)); }
+		static Vec load_int8(const int8_t* ptr) { return _mm512_cvtepi32_ps(_mm512_cvtepi8_epi32(_mm_loadu_si128((const __m128i*)ptr))); }
+	};
+}
+
+void forward_batch_avx512(const Batch_kernel_args& args) {
+	forward_batch_kernel<Avx512_ops>(args);
+}
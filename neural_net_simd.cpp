@@ -0,0 +1,96 @@
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+#include <neural_net_simd.h>
+
+#if defined(DONKEY_SIMD_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+Simd_level detect_simd_level() {
+#if defined(DONKEY_SIMD_X86)
+#if defined(_MSC_VER)
+	int cpu_info[4] = {};
+	__cpuid(cpu_info, 0);
+	auto max_leaf = cpu_info[0];
+	__cpuid(cpu_info, 1);
+	auto has_sse42 = (cpu_info[2] & (1 << 20)) != 0;
+	auto has_osxsave = (cpu_info[2] & (1 << 27)) != 0;
+	auto has_avx2 = false;
+	auto has_avx512 = false;
+
+	if (has_osxsave && (max_leaf >= 7)) {
+		auto xcr0 = _xgetbv(0);
+		__cpuidex(cpu_info, 7, 0);
+		has_avx2 = ((xcr0 & 0x6) == 0x6) && ((cpu_info[1] & (1 << 5)) != 0);
+		has_avx512 = ((xcr0 & 0xe6) == 0xe6) && ((cpu_info[1] & (1 << 16)) != 0);
+	}
+#else
+	__builtin_cpu_init();
+	auto has_sse42 = __builtin_cpu_supports("sse4.2") != 0;
+	auto has_avx2 = __builtin_cpu_supports("avx2") != 0;
+	auto has_avx512 = __builtin_cpu_supports("avx512f") != 0;
+#endif
+
+	if (has_avx512) {
+		return Simd_level::Avx512;
+	}
+
+	if (has_avx2) {
+		return Simd_level::Avx2;
+	}
+
+	if (has_sse42) {
+		return Simd_level::Sse42;
+	}
+#endif
+
+	return Simd_level::Scalar;
+}
+
+const char* simd_level_name(Simd_level simd_level) {
+	switch (simd_level) {
+	case Simd_level::Scalar: return "scalar";
+	case Simd_level::Sse42: return "sse4.2";
+	case Simd_level::Avx2: return "avx2";
+	case Simd_level::Avx512: return "avx512";
+	}
+
+	return "unknown";
+}
+
+const char* weight_precision_name(Weight_precision precision) {
+	switch (precision) {
+	case Weight_precision::Fp32: return "fp32";
+	case Weight_precision::Fp16: return "fp16";
+	case Weight_precision::Int8: return "int8";
+	}
+
+	return "unknown";
+}
+
+uint16_t float_to_half(float value) {
+	auto sign = static_cast<uint16_t>((std::bit_cast<uint32_t>(value) >> 16) & 0x8000);
+	auto bits = std::bit_cast<uint32_t>(std::min(std::fabs(value), 65504.0f));
+
+	// Below the smallest normal half: adding 0.5 leaves the rounded denormal in the low mantissa bits
+	if (bits < 0x38800000) {
+		auto rounded = std::bit_cast<float>(bits) + 0.5f;
+
+		return sign | static_cast<uint16_t>(std::bit_cast<uint32_t>(rounded) - std::bit_cast<uint32_t>(0.5f));
+	}
+
+	// Rebias the exponent from 127 to 15 and round the 13 dropped mantissa bits to nearest even
+	auto is_odd = (bits >> 13) & 1;
+	bits += 0xc8000fffu + is_odd;
+
+	return sign | static_cast<uint16_t>(bits >> 13);
+}
+
+float half_to_float(uint16_t half) {
+	// Shifted into a float, the half's exponent is 112 too small. Scaling fixes it and also normalises denormals.
+	auto magnitude = std::bit_cast<float>(static_cast<uint32_t>(half & 0x7fff) << 13) * 0x1p112f;
+
+	return std::bit_cast<float>(std::bit_cast<uint32_t>(magnitude) | (static_cast<uint32_t>(half & 0x8000) << 16));
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+
+enum class Simd_level {
+	Scalar,
+	Sse42,
+	Avx2,
+	Avx512
+};
+
+// How Batch_weights stores weights. Fp16 is IEEE half precision. Int8 is a signed byte per weight times
+//	one scale per genome, max |weight| / 127. Kernels dequantise in registers, and since the conversions
+//	to float are exact every level sees the same weights.
+enum class Weight_precision {
+	Fp32,
+	Fp16,
+	Int8
+};
+
+// Everything a batch kernel needs, see Neural_net::forward_batch for the layouts
+struct Batch_kernel_args {
+	const float* inputs = nullptr;
+	uint32_t input_stride = {};
+	Weight_precision precision = Weight_precision::Fp32;
+	// The one for precision is set
+	const float* weights = nullptr;
+	const uint16_t* weights_fp16 = nullptr;
+	const int8_t* weights_int8 = nullptr;
+	const float* scales = nullptr;
+	uint32_t num_genomes = {};
+	uint32_t num_inputs = {};
+	uint32_t num_hidden = {};
+	uint32_t num_outputs = {};
+	uint32_t idx_genome_begin = {};
+	uint32_t idx_genome_end = {};
+	uint32_t* idx_best_outputs = nullptr;
+	// num_hidden * 16 floats
+	float* hidden_scratch = nullptr;
+};
+
+// Best level supported by both this build and the CPU we are running on
+Simd_level detect_simd_level();
+const char* simd_level_name(Simd_level simd_level);
+const char* weight_precision_name(Weight_precision precision);
+// Rounds to nearest even and clamps to the largest finite half, 65504
+uint16_t float_to_half(float value);
+// Exact for every finite half, bit for bit what the vector kernels compute
+float half_to_float(uint16_t half);
+
+// The vector kernels replace std::tanh with a rational approximation (odd degree 13 over even degree 6,
+//	argument clamped to +-7.9053). Its absolute and relative error against double precision tanh is below
+//	4e-7 for every float with magnitude above 1e-30; smaller arguments flush to zero. Per-genome results
+//	are identical between the vector ISAs, but can differ from the scalar std::tanh reference in the last bits.
+void forward_batch_sse42(const Batch_kernel_args& args);
+void forward_batch_avx2(const Batch_kernel_args& args);
+void forward_batch_avx512(const Batch_kernel_args& args);
@@ -0,0 +1,167 @@
+#pragma once
+
+// Shared body of the vector batch kernels. Only included by the per-ISA translation units, which are
+//	compiled with their own instruction set flags, so everything here has internal linkage to keep the
+//	linker from mixing instantiations across ISAs.
+
+#include <neural_net_simd.h>
+
+namespace {
+	inline float tanh_approx(float v) {
+		auto x = v < -7.90531110763549805f ? -7.90531110763549805f : v;
+		x = x > 7.90531110763549805f ? 7.90531110763549805f : x;
+		auto x2 = x * x;
+		auto p = -2.76076847742355e-16f;
+		p = p * x2 + 2.00018790482477e-13f;
+		p = p * x2 + -8.60467152213735e-11f;
+		p = p * x2 + 5.12229709037114e-08f;
+		p = p * x2 + 1.48572235717979e-05f;
+		p = p * x2 + 6.37261928875436e-04f;
+		p = p * x2 + 4.89352455891786e-03f;
+		p = p * x;
+		auto q = 1.19825839466702e-06f;
+		q = q * x2 + 1.18534705686654e-04f;
+		q = q * x2 + 2.26843463243900e-03f;
+		q = q * x2 + 4.89352518554385e-03f;
+
+		return p / q;
+	}
+
+	template <typename Ops>
+	typename Ops::Vec tanh_approx(typename Ops::Vec v) {
+		auto x = Ops::max(Ops::min(v, Ops::set1(7.90531110763549805f)), Ops::set1(-7.90531110763549805f));
+		auto x2 = Ops::mul(x, x);
+		auto p = Ops::set1(-2.76076847742355e-16f);
+		p = Ops::add(Ops::mul(p, x2), Ops::set1(2.00018790482477e-13f));
+		p = Ops::add(Ops::mul(p, x2), Ops::set1(-8.60467152213735e-11f));
+		p = Ops::add(Ops::mul(p, x2), Ops::set1(5.12229709037114e-08f));
+		p = Ops::add(Ops::mul(p, x2), Ops::set1(1.48572235717979e-05f));
+		p = Ops::add(Ops::mul(p, x2), Ops::set1(6.37261928875436e-04f));
+		p = Ops::add(Ops::mul(p, x2), Ops::set1(4.89352455891786e-03f));
+		p = Ops::mul(p, x);
+		auto q = Ops::set1(1.19825839466702e-06f);
+		q = Ops::add(Ops::mul(q, x2), Ops::set1(1.18534705686654e-04f));
+		q = Ops::add(Ops::mul(q, x2), Ops::set1(2.26843463243900e-03f));
+		q = Ops::add(Ops::mul(q, x2), Ops::set1(4.89352518554385e-03f));
+
+		return Ops::div(p, q);
+	}
+
+	// Weights idx_weight * num_genomes + idx_genome of width consecutive genomes, as floats. scale holds
+	//	the genomes' Int8 scales.
+	template <typename Ops, Weight_precision precision>
+	typename Ops::Vec load_weights(const Batch_kernel_args& args, uint64_t idx, typename Ops::Vec scale) {
+		if constexpr (precision == Weight_precision::Fp16) {
+			return Ops::load_fp16(args.weights_fp16 + idx);
+		}
+		else if constexpr (precision == Weight_precision::Int8) {
+			return Ops::mul(Ops::load_int8(args.weights_int8 + idx), scale);
+		}
+		else {
+			return Ops::load(args.weights + idx);
+		}
+	}
+
+	template <Weight_precision precision>
+	float load_weight(const Batch_kernel_args& args, uint64_t idx, uint32_t idx_genome) {
+		if constexpr (precision == Weight_precision::Fp16) {
+			return half_to_float(args.weights_fp16[idx]);
+		}
+		else if constexpr (precision == Weight_precision::Int8) {
+			return (float)args.weights_int8[idx] * args.scales[idx_genome];
+		}
+		else {
+			return args.weights[idx];
+		}
+	}
+
+	// Lanes map to genomes. Sums run over the same index order as the scalar reference.
+	template <typename Ops, Weight_precision precision>
+	void forward_batch_kernel(const Batch_kernel_args& args) {
+		constexpr auto width = Ops::width;
+		auto num_genomes = static_cast<uint64_t>(args.num_genomes);
+		auto offset = static_cast<uint64_t>(args.num_inputs) * args.num_hidden;
+		auto hidden = args.hidden_scratch;
+		auto idx_genome = args.idx_genome_begin;
+
+		for (; idx_genome + width <= args.idx_genome_end; idx_genome += width) {
+			auto inputs = args.inputs + idx_genome;
+			auto scale = (precision == Weight_precision::Int8) ? Ops::load(args.scales + idx_genome) : Ops::zero();
+
+			for (uint32_t idx_hidden = 0; idx_hidden < args.num_hidden; ++idx_hidden) {
+				auto acc = Ops::zero();
+
+				for (uint32_t idx_input = 0; idx_input < args.num_inputs; ++idx_input) {
+					auto input = Ops::load(inputs + static_cast<uint64_t>(idx_input) * args.input_stride);
+					auto weight = load_weights<Ops, precision>(args, (static_cast<uint64_t>(idx_input) * args.num_hidden + idx_hidden) * num_genomes + idx_genome, scale);
+					acc = Ops::add(acc, Ops::mul(input, weight));
+				}
+
+				Ops::store(hidden + idx_hidden * width, tanh_approx<Ops>(acc));
+			}
+
+			auto best_value = Ops::zero();
+			auto best_output = Ops::zero();
+
+			for (uint32_t idx_output = 0; idx_output < args.num_outputs; ++idx_output) {
+				auto acc = Ops::zero();
+
+				for (uint32_t idx_hidden = 0; idx_hidden < args.num_hidden; ++idx_hidden) {
+					auto weight = load_weights<Ops, precision>(args, (offset + static_cast<uint64_t>(idx_hidden) * args.num_outputs + idx_output) * num_genomes + idx_genome, scale);
+					acc = Ops::add(acc, Ops::mul(Ops::load(hidden + idx_hidden * width), weight));
+				}
+
+				if (idx_output == 0) {
+					best_value = acc;
+					continue;
+				}
+
+				// First maximum wins
+				best_output = Ops::select_lt(best_value, acc, Ops::set1((float)idx_output), best_output);
+				best_value = Ops::select_lt(best_value, acc, acc, best_value);
+			}
+
+			Ops::store_indices(args.idx_best_outputs + idx_genome, best_output);
+		}
+
+		for (; idx_genome < args.idx_genome_end; ++idx_genome) {
+			auto idx_best_output = uint32_t{};
+			auto best_value = 0.0f;
+
+			for (uint32_t idx_hidden = 0; idx_hidden < args.num_hidden; ++idx_hidden) {
+				auto acc = 0.0f;
+
+				for (uint32_t idx_input = 0; idx_input < args.num_inputs; ++idx_input) {
+					acc += args.inputs[static_cast<uint64_t>(idx_input) * args.input_stride + idx_genome]
+						* load_weight<precision>(args, (static_cast<uint64_t>(idx_input) * args.num_hidden + idx_hidden) * num_genomes + idx_genome, idx_genome);
+				}
+
+				hidden[idx_hidden] = tanh_approx(acc);
+			}
+
+			for (uint32_t idx_output = 0; idx_output < args.num_outputs; ++idx_output) {
+				auto acc = 0.0f;
+
+				for (uint32_t idx_hidden = 0; idx_hidden < args.num_hidden; ++idx_hidden) {
+					acc += hidden[idx_hidden] * load_weight<precision>(args, (offset + static_cast<uint64_t>(idx_hidden) * args.num_outputs + idx_output) * num_genomes + idx_genome, idx_genome);
+				}
+
+				if ((idx_output == 0) || (best_value < acc)) {
+					best_value = acc;
+					idx_best_output = idx_output;
+				}
+			}
+
+			args.idx_best_outputs[idx_genome] = idx_best_output;
+		}
+	}
+
+	template <typename Ops>
+	void forward_batch_kernel(const Batch_kernel_args& args) {
+		switch (args.precision) {
+		case Weight_precision::Fp32: forward_batch_kernel<Ops, Weight_precision::Fp32>(args); break;
+		case Weight_precision::Fp16: forward_batch_kernel<Ops, Weight_precision::Fp16>(args); break;
+		case Weight_precision::Int8: forward_batch_kernel<Ops, Weight_precision::Int8>(args); break;
+		}
+	}
+}
@@ -0,0 +1,39 @@
+#include <cstring>
+
+#include <immintrin.h>
+
+#include <neural_net_simd_impl.h>
+
+namespace {
+	struct Sse42_ops {
+		using Vec = __m128;
+		static constexpr uint32_t width = 4;
+
+		static Vec zero() { return _mm_setzero_ps(); }
+		static Vec set1(float value) { return _mm_set1_ps(value); }
+		static Vec load(const float* ptr) { return _mm_loadu_ps(ptr); }
+		static void store(float* ptr, Vec value) { _mm_storeu_ps(ptr, value); }
+		static Vec add(Vec a, Vec b) { return _mm_add_ps(a, b); }
+		static Vec mul(Vec a, Vec b) { return _mm_mul_ps(a, b); }
+		static Vec div(Vec a, Vec b) { return _mm_div_ps(a, b); }
+		static Vec min(Vec a, Vec b) { return _mm_min_ps(a, b); }
+		static Vec max(Vec a, Vec b) { return _mm_max_ps(a, b); }
+		static Vec select_lt(Vec a, Vec b, Vec if_less, Vec otherwise) { return _mm_blendv_ps(otherwise, if_less, _mm_cmplt_ps(a, b)); }
+		static void store_indices(uint32_t* ptr, Vec value) { _mm_storeu_si128((__m128i*)ptr, _mm_cvttps_epi32(value)); }
+		// Widened to 32 bits, a half's exponent is 112 too small; scaling fixes it and normalises denormals
+		static Vec load_fp16(const uint16_t* ptr) {
+			auto half = _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*)ptr));
+			auto magnitude = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(half, _mm_set1_epi32(0x7fff)), 13)), _mm_set1_ps(0x1p112f));
+			return _mm_or_ps(magnitude, _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(half, _mm_set1_epi32(0x8000)), 16)));
+		}
+		static Vec load_int8(const int8_t* ptr) {
+			auto bytes = int32_t();
+			std::memcpy(&bytes, ptr, sizeof(bytes));
+			return _mm_cvtepi32_ps(_mm_cvtepi8_epi32(_mm_cvtsi32_si128(bytes)));
+		}
+	};
+}
+
+void forward_batch_sse42(const Batch_kernel_args& args) {
+	forward_batch_kernel<Sse42_ops>(args);
+}
@@ -0,0 +1,170 @@
+#ifdef DONKEY_PROFILE
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <profile.h>
+
+namespace {
+	struct Thread_counters {
+		Profile_counters live = {};
+		// What the previous collect read, so collecting never has to write to another thread's counters
+		Profile_counters collected = {};
+	};
+
+	// Counters are owned here rather than by the threads, so they outlive threads that exit before a collect
+	std::mutex registry_mutex = {};
+	std::vector<std::unique_ptr<Thread_counters>> registry = {};
+
+	uint64_t load_relaxed(uint64_t& counter) {
+		return std::atomic_ref<uint64_t>(counter).load(std::memory_order_relaxed);
+	}
+
+	// live - collected, field by field, leaving collected at live
+	Profile_counters take_delta(Thread_counters& counters) {
+		auto delta = Profile_counters();
+		auto take = [](uint64_t& live, uint64_t& collected, uint64_t& out) {
+			auto value = load_relaxed(live);
+			out = value - collected;
+			collected = value;
+			};
+
+		for (size_t idx_phase = 0; idx_phase < num_profile_phases; idx_phase++) {
+			auto& live = counters.live.phases[idx_phase];
+			auto& collected = counters.collected.phases[idx_phase];
+			auto& out = delta.phases[idx_phase];
+
+			take(live.num_calls, collected.num_calls, out.num_calls);
+			take(live.total_ns, collected.total_ns, out.total_ns);
+
+			for (size_t idx_bucket = 0; idx_bucket < out.histogram.size(); idx_bucket++) {
+				take(live.histogram[idx_bucket], collected.histogram[idx_bucket], out.histogram[idx_bucket]);
+			}
+		}
+
+		take(counters.live.num_steps, counters.collected.num_steps, delta.num_steps);
+		take(counters.live.num_agent_steps, counters.collected.num_agent_steps, delta.num_agent_steps);
+
+		return delta;
+	}
+}
+
+const char* profile_phase_name(Profile_phase phase) {
+	switch (phase) {
+	case Profile_phase::Game_logics: return "game_logics";
+	case Profile_phase::Observe: return "observe";
+	case Profile_phase::Brain_run: return "brain_run";
+	case Profile_phase::Physics: return "physics";
+	case Profile_phase::Kill_agents: return "kill_agents";
+	case Profile_phase::Brain_update: return "brain_update";
+	case Profile_phase::New_generation: return "new_generation";
+	case Profile_phase::Render: return "render";
+	case Profile_phase::Count: break;
+	}
+
+	return "unknown";
+}
+
+double Profile_counters::Phase::quantile_ns(double q) const {
+	if (num_calls == 0) {
+		return 0.0;
+	}
+
+	auto num_below = uint64_t{};
+	auto rank = static_cast<uint64_t>(q * static_cast<double>(num_calls));
+
+	for (size_t idx_bucket = 0; idx_bucket < histogram.size(); idx_bucket++) {
+		num_below += histogram[idx_bucket];
+
+		if ((num_below > rank) || (num_below == num_calls)) {
+			return static_cast<double>(uint64_t{ 1 } << idx_bucket);
+		}
+	}
+
+	return 0.0;
+}
+
+void Profile_counters::add(const Profile_counters& other) {
+	for (size_t idx_phase = 0; idx_phase < num_profile_phases; idx_phase++) {
+		auto& phase = phases[idx_phase];
+		auto& other_phase = other.phases[idx_phase];
+
+		phase.num_calls += other_phase.num_calls;
+		phase.total_ns += other_phase.total_ns;
+
+		for (size_t idx_bucket = 0; idx_bucket < phase.histogram.size(); idx_bucket++) {
+			phase.histogram[idx_bucket] += other_phase.histogram[idx_bucket];
+		}
+	}
+
+	num_steps += other.num_steps;
+	num_agent_steps += other.num_agent_steps;
+}
+
+Profile_counters& profile_counters() {
+	thread_local Profile_counters* counters = nullptr;
+
+	if (!counters) {
+		auto lock = std::lock_guard(registry_mutex);
+		registry.push_back(std::make_unique<Thread_counters>());
+		counters = &registry.back()->live;
+	}
+
+	return *counters;
+}
+
+void profile_add(uint64_t& counter, uint64_t value) {
+	// Single writer, so a plain read and an atomic store cannot lose an update
+	std::atomic_ref<uint64_t>(counter).store(counter + value, std::memory_order_relaxed);
+}
+
+Profile_counters profile_collect() {
+	auto lock = std::lock_guard(registry_mutex);
+	auto total = Profile_counters();
+
+	for (auto& counters : registry) {
+		total.add(take_delta(*counters));
+	}
+
+	return total;
+}
+
+Profile_scope::~Profile_scope() {
+	auto time_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - time_start).count());
+	auto& counters = profile_counters().phases[static_cast<size_t>(phase)];
+
+	profile_add(counters.num_calls, 1);
+	profile_add(counters.total_ns, time_ns);
+	profile_add(counters.histogram[std::min<size_t>(std::bit_width(time_ns), counters.histogram.size() - 1)], 1);
+}
+
+bool Profile_report::open(const std::string& path) {
+	file.open(path, std::ios::trunc);
+	file << "generation,time_s,steps,agent_steps,steps_per_s,agent_steps_per_s";
+
+	for (size_t idx_phase = 0; idx_phase < num_profile_phases; idx_phase++) {
+		auto name = std::string(profile_phase_name(static_cast<Profile_phase>(idx_phase)));
+		file << "," << name << "_ms," << name << "_calls," << name << "_p50_us," << name << "_p99_us";
+	}
+
+	file << "\n";
+
+	return file.good();
+}
+
+void Profile_report::write(int generation, double time_s, const Profile_counters& counters) {
+	file << generation << "," << time_s << "," << counters.num_steps << "," << counters.num_agent_steps
+		<< "," << counters.num_steps / time_s << "," << counters.num_agent_steps / time_s;
+
+	for (auto& phase : counters.phases) {
+		file << "," << phase.total_ns / 1e6 << "," << phase.num_calls << "," << phase.quantile_ns(0.5) / 1e3 << "," << phase.quantile_ns(0.99) / 1e3;
+	}
+
+	file << std::endl;
+}
+
+#endif
@@ -0,0 +1,93 @@
+#pragma once
+
+// Per-phase timing of the simulation. Built in only when DONKEY_PROFILE is defined (cmake -DDONKEY_PROFILE=ON);
+//	otherwise the DONKEY_PROFILE_* macros expand to nothing and none of this exists.
+
+#ifdef DONKEY_PROFILE
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+enum class Profile_phase {
+	Game_logics,
+	Observe,
+	Brain_run,
+	Physics,
+	Kill_agents,
+	Brain_update,
+	// Part of Brain_update
+	New_generation,
+	Render,
+	Count
+};
+
+constexpr size_t num_profile_phases = static_cast<size_t>(Profile_phase::Count);
+
+const char* profile_phase_name(Profile_phase phase);
+
+struct Profile_counters {
+	struct Phase {
+		uint64_t num_calls = 0;
+		uint64_t total_ns = 0;
+		// Call durations by bit width: histogram[idx] counts calls of [2^(idx-1), 2^idx) ns
+		std::array<uint64_t, 64> histogram = {};
+
+		// Upper bound of the histogram bucket holding quantile q of the calls
+		double quantile_ns(double q) const;
+	};
+
+	void add(const Profile_counters& other);
+
+	std::array<Phase, num_profile_phases> phases = {};
+	// Steps over all Sim_states, and agents still alive after each of them
+	uint64_t num_steps = 0;
+	uint64_t num_agent_steps = 0;
+};
+
+// Counters of the calling thread. Every thread gets its own, so recording never synchronizes. Only the
+//	owning thread writes them, through profile_add.
+Profile_counters& profile_counters();
+// Relaxed atomic add to a counter of the calling thread, so profile_collect can read it at any time
+void profile_add(uint64_t& counter, uint64_t value);
+// Sums what every thread recorded since the previous collect. Threads may keep recording meanwhile; a
+//	phase that is still running is counted in the next collect.
+Profile_counters profile_collect();
+
+// Times its own lifetime into the calling thread's counters
+class Profile_scope {
+public:
+	Profile_scope(Profile_phase phase) : phase(phase), time_start(std::chrono::steady_clock::now()) {}
+	~Profile_scope();
+	Profile_scope(const Profile_scope&) = delete;
+	Profile_scope& operator=(const Profile_scope&) = delete;
+private:
+	Profile_phase phase = {};
+	std::chrono::steady_clock::time_point time_start = {};
+};
+
+// One CSV row per generation: wall time, throughput and, per phase, the time summed over all threads,
+//	the number of calls and the median and p99 call durations.
+class Profile_report {
+public:
+	// Writes the header. False if path cannot be opened.
+	bool open(const std::string& path);
+	void write(int generation, double time_s, const Profile_counters& counters);
+private:
+	std::ofstream file = {};
+};
+
+#define DONKEY_PROFILE_CONCAT_INNER(a, b) a##b
+#define DONKEY_PROFILE_CONCAT(a, b) DONKEY_PROFILE_CONCAT_INNER(a, b)
+#define DONKEY_PROFILE_SCOPE(phase) Profile_scope DONKEY_PROFILE_CONCAT(profile_scope_, __LINE__)(Profile_phase::phase)
+#define DONKEY_PROFILE_STEP(num_alive) \
+	do { auto& profile_step_counters = profile_counters(); profile_add(profile_step_counters.num_steps, 1); profile_add(profile_step_counters.num_agent_steps, (num_alive)); } while (false)
+
+#else
+
+#define DONKEY_PROFILE_SCOPE(phase) static_cast<void>(0)
+#define DONKEY_PROFILE_STEP(num_alive) static_cast<void>(0)
+
+#endif
@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+
+#include <random.h>
+
+namespace {
+	uint64_t splitmix64(uint64_t& x) {
+		auto z = (x += 0x9e3779b97f4a7c15ull);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+
+		return z ^ (z >> 31);
+	}
+
+	uint64_t rotl(uint64_t x, int k) {
+		return (x << k) | (x >> (64 - k));
+	}
+}
+
+Random::Random(uint64_t seed) {
+	for (auto& word : state) {
+		word = splitmix64(seed);
+	}
+}
+
+Random Random::stream(uint64_t seed, uint32_t idx_stream) {
+	auto random = Random(seed);
+
+	for (uint32_t idx_jump = 0; idx_jump < idx_stream; idx_jump++) {
+		random.jump();
+	}
+
+	return random;
+}
+
+uint64_t Random::next() {
+	auto result = rotl(state[1] * 5, 7) * 9;
+	auto t = state[1] << 17;
+
+	state[2] ^= state[0];
+	state[3] ^= state[1];
+	state[1] ^= state[2];
+	state[0] ^= state[3];
+	state[2] ^= t;
+	state[3] = rotl(state[3], 45);
+
+	return result;
+}
+
+float Random::uniform() {
+	return (next() >> 40) * 0x1.0p-24f;
+}
+
+float Random::uniform(float min, float max) {
+	return min + uniform() * (max - min);
+}
+
+uint32_t Random::below(uint32_t n) {
+	return static_cast<uint32_t>(((next() >> 32) * n) >> 32);
+}
+
+bool Random::coin() {
+	return (next() >> 63) != 0;
+}
+
+float Random::gaussian(float mean, float stddev) {
+	auto u1 = 1.0f - uniform();
+	auto u2 = uniform();
+
+	return mean + stddev * std::sqrt(-2.0f * std::log(u1)) * std::cos(2.0f * std::numbers::pi_v<float> * u2);
+}
+
+void Random::fill_uniform(std::span<float> out, float min, float max) {
+	for (auto& value : out) {
+		value = uniform(min, max);
+	}
+}
+
+void Random::fill_coins(std::span<uint8_t> out) {
+	auto idx = size_t{};
+
+	while (idx < out.size()) {
+		auto bits = next();
+		auto num_bits = std::min<size_t>(64, out.size() - idx);
+
+		for (size_t idx_bit = 0; idx_bit < num_bits; idx_bit++) {
+			out[idx + idx_bit] = static_cast<uint8_t>((bits >> idx_bit) & 1);
+		}
+
+		idx += num_bits;
+	}
+}
+
+void Random::fill_gaussian(std::span<float> out, float mean, float stddev) {
+	for (size_t idx = 0; idx < out.size(); idx += 2) {
+		auto u1 = 1.0f - uniform();
+		auto u2 = uniform();
+		auto radius = stddev * std::sqrt(-2.0f * std::log(u1));
+		auto angle = 2.0f * std::numbers::pi_v<float> * u2;
+
+		out[idx] = mean + radius * std::cos(angle);
+
+		if (idx + 1 < out.size()) {
+			out[idx + 1] = mean + radius * std::sin(angle);
+		}
+	}
+}
+
+Random::State Random::get_state() const {
+	return state;
+}
+
+void Random::set_state(const State& new_state) {
+	state = new_state;
+}
+
+void Random::jump() {
+	constexpr uint64_t jump_polynomial[] = { 0x180ec6d33cfd0abaull, 0xd5a61266f0c9392cull, 0xa9582618e03fc9aaull, 0x39abdc4529b1661cull };
+	auto jumped = State{};
+
+	for (auto polynomial : jump_polynomial) {
+		for (int idx_bit = 0; idx_bit < 64; idx_bit++) {
+			if (polynomial & (1ull << idx_bit)) {
+				for (size_t idx_word = 0; idx_word < jumped.size(); idx_word++) {
+					jumped[idx_word] ^= state[idx_word];
+				}
+			}
+
+			next();
+		}
+	}
+
+	state = jumped;
+}
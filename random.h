@@ -0,0 +1,38 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <span>
+
+// xoshiro256** (Blackman & Vigna). Small, fast and good enough for evolution and barrel spawning.
+//	Not thread-safe: give every thread its own stream.
+class Random {
+public:
+	using State = std::array<uint64_t, 4>;
+
+	Random(uint64_t seed = 0);
+	// Stream idx_stream of a run seed. Streams are 2^128 steps apart and never overlap.
+	static Random stream(uint64_t seed, uint32_t idx_stream);
+
+	uint64_t next();
+	// [0, 1)
+	float uniform();
+	float uniform(float min, float max);
+	// [0, n), multiply-shift so the bias is below n / 2^32
+	uint32_t below(uint32_t n);
+	bool coin();
+	float gaussian(float mean, float stddev);
+
+	void fill_uniform(std::span<float> out, float min, float max);
+	// One 0/1 byte per element, 64 elements per generator call
+	void fill_coins(std::span<uint8_t> out);
+	// Box-Muller, two values per pair of uniforms
+	void fill_gaussian(std::span<float> out, float mean, float stddev);
+
+	State get_state() const;
+	void set_state(const State& new_state);
+private:
+	void jump();
+
+	State state = {};
+};
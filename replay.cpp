@@ -0,0 +1,263 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <type_traits>
+
+#include <replay.h>
+
+static_assert(std::is_trivially_copyable_v<Replay_header>);
+static_assert(std::is_trivially_copyable_v<Replay_agent>);
+
+namespace {
+	void set_bits(std::vector<uint8_t>& bytes, size_t idx_bit, uint8_t value) {
+		bytes[idx_bit / 8] |= static_cast<uint8_t>(value << (idx_bit % 8));
+	}
+
+	uint8_t get_bits(const std::vector<uint8_t>& bytes, size_t idx_bit, uint8_t mask) {
+		return (bytes[idx_bit / 8] >> (idx_bit % 8)) & mask;
+	}
+
+	size_t packed_action_bytes(uint32_t num_actions) {
+		return (static_cast<size_t>(num_actions) * 2 + 7) / 8;
+	}
+}
+
+void Replay_recorder::begin(const Sim_state& sim) {
+	num_agents = static_cast<uint32_t>(sim.players.size());
+	bytes_per_step = static_cast<uint32_t>(packed_action_bytes(num_agents));
+
+	header = Replay_header();
+	header.generation = sim.generation;
+	header.initial_jump_size = settings.game.initial_jump_size;
+	header.last_clear_physics_step = sim.kill_state.last_clear_physics_step;
+	header.last_clear_no_move = sim.kill_state.last_clear_no_move;
+
+	actions.clear();
+	spawns.clear();
+	num_actions.assign(num_agents, 0);
+	recording.assign(sim.players.alive.begin(), sim.players.alive.end());
+	pos_previous_x.assign(sim.kill_state.pos_previous_x.begin(), sim.kill_state.pos_previous_x.end());
+	pos_previous_y.assign(sim.kill_state.pos_previous_y.begin(), sim.kill_state.pos_previous_y.end());
+}
+
+void Replay_recorder::record_step(const Sim_state& sim) {
+	auto idx_step = static_cast<uint32_t>(sim.num_physics_steps - 1);
+
+	if (idx_step % barrel_spawn_interval == 0) {
+		// A barrel cannot reach a wall in the step it spawns in, so its v_x is still the spawn direction
+		auto& barrels = sim.barrel_buffer.elements;
+		auto rolling_right = barrels.v_x[sim.barrel_buffer.idx_newest()] > 0;
+
+		if (header.num_spawns % 8 == 0) {
+			spawns.push_back(0);
+		}
+
+		set_bits(spawns, header.num_spawns, rolling_right ? 1 : 0);
+		header.num_spawns++;
+	}
+
+	actions.resize(actions.size() + bytes_per_step);
+
+	for (uint32_t idx_agent = 0; idx_agent < num_agents; idx_agent++) {
+		if (!recording[idx_agent]) {
+			continue;
+		}
+
+		set_bits(actions, static_cast<size_t>(idx_step) * bytes_per_step * 8 + idx_agent * 2, static_cast<uint8_t>(sim.batch_actions[idx_agent]));
+		num_actions[idx_agent]++;
+		recording[idx_agent] = sim.players.alive[idx_agent];
+	}
+
+	header.num_steps = sim.num_physics_steps;
+}
+
+uint8_t Replay_recorder::action(uint32_t idx_step, uint32_t idx_agent) const {
+	return get_bits(actions, static_cast<size_t>(idx_step) * bytes_per_step * 8 + idx_agent * 2, 3);
+}
+
+bool Replay_recorder::write(const std::string& path, std::span<const uint32_t> idx_agents, const Sim_state& sim) const {
+	auto file_header = header;
+	auto agents = std::vector<Replay_agent>();
+	auto agent_actions = std::vector<uint8_t>();
+
+	file_header.num_agents = static_cast<uint32_t>(idx_agents.size());
+
+	for (auto idx_agent : idx_agents) {
+		auto agent = Replay_agent();
+		agent.idx_agent = idx_agent;
+		agent.num_actions = num_actions[idx_agent];
+		agent.pos_previous_x = pos_previous_x[idx_agent];
+		agent.pos_previous_y = pos_previous_y[idx_agent];
+		agent.score = sim.players.score[idx_agent];
+		agent.level = sim.players.level[idx_agent];
+		agents.push_back(agent);
+
+		auto packed = std::vector<uint8_t>(packed_action_bytes(agent.num_actions));
+
+		for (uint32_t idx_step = 0; idx_step < agent.num_actions; idx_step++) {
+			set_bits(packed, static_cast<size_t>(idx_step) * 2, action(idx_step, idx_agent));
+		}
+
+		agent_actions.insert(agent_actions.end(), packed.begin(), packed.end());
+	}
+
+	auto file = std::ofstream(path, std::ios::binary | std::ios::trunc);
+
+	file.write(reinterpret_cast<const char*>(&file_header), sizeof(file_header));
+	file.write(reinterpret_cast<const char*>(agents.data()), static_cast<std::streamsize>(agents.size() * sizeof(Replay_agent)));
+	file.write(reinterpret_cast<const char*>(spawns.data()), static_cast<std::streamsize>(spawns.size()));
+	file.write(reinterpret_cast<const char*>(agent_actions.data()), static_cast<std::streamsize>(agent_actions.size()));
+
+	return file.good();
+}
+
+bool Replay_player::load(const std::string& path, const Level& level) {
+	auto file = std::ifstream(path, std::ios::binary);
+	auto bytes = std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	auto expected = Replay_header();
+	auto offset = sizeof(Replay_header);
+
+	if (bytes.size() < sizeof(Replay_header)) {
+		std::cerr << "Could not read replay " << path << "\n";
+		return false;
+	}
+
+	std::memcpy(&header, bytes.data(), sizeof(header));
+
+	if (!std::equal(std::begin(header.magic), std::end(header.magic), std::begin(expected.magic))
+		|| (header.version != replay_version) || (header.header_size != sizeof(Replay_header))) {
+		std::cerr << "Replay " << path << " is not a version " << replay_version << " replay\n";
+		return false;
+	}
+
+	if (header.initial_jump_size != settings.game.initial_jump_size) {
+		std::cerr << "Replay " << path << " was recorded with a different jump size\n";
+		return false;
+	}
+
+	auto num_spawn_bytes = (static_cast<size_t>(header.num_spawns) + 7) / 8;
+
+	if ((header.num_steps < 0) || (bytes.size() < offset + header.num_agents * sizeof(Replay_agent) + num_spawn_bytes)
+		|| (header.num_spawns < static_cast<uint32_t>((header.num_steps + barrel_spawn_interval - 1) / barrel_spawn_interval))) {
+		std::cerr << "Replay " << path << " is truncated\n";
+		return false;
+	}
+
+	agents.resize(header.num_agents);
+	std::memcpy(agents.data(), bytes.data() + offset, agents.size() * sizeof(Replay_agent));
+	offset += agents.size() * sizeof(Replay_agent);
+	spawns.assign(bytes.begin() + offset, bytes.begin() + offset + num_spawn_bytes);
+	offset += num_spawn_bytes;
+	actions.clear();
+
+	for (auto& agent : agents) {
+		auto num_bytes = packed_action_bytes(agent.num_actions);
+
+		if ((agent.num_actions > static_cast<uint32_t>(header.num_steps)) || (bytes.size() < offset + num_bytes)) {
+			std::cerr << "Replay " << path << " is truncated\n";
+			return false;
+		}
+
+		actions.emplace_back(bytes.begin() + offset, bytes.begin() + offset + num_bytes);
+		offset += num_bytes;
+	}
+
+	step_actions.resize(agents.size());
+	sim.verbose = false;
+	sim.is_human = false;
+	restart();
+	keyframes.resize(static_cast<size_t>(header.num_steps / replay_keyframe_interval) + 1);
+
+	for (auto& keyframe : keyframes) {
+		save_keyframe(keyframe);
+
+		for (auto idx_step = 0; idx_step < replay_keyframe_interval; idx_step++) {
+			step(level);
+		}
+	}
+
+	restart();
+
+	return true;
+}
+
+void Replay_player::seek(const Level& level, int idx_step) {
+	idx_step = std::clamp(idx_step, 0, header.num_steps);
+	load_keyframe(keyframes[idx_step / replay_keyframe_interval]);
+
+	while (sim.num_physics_steps < idx_step) {
+		step(level);
+	}
+}
+
+bool Replay_player::step(const Level& level) {
+	if (sim.num_physics_steps >= header.num_steps) {
+		return false;
+	}
+
+	auto idx_step = sim.num_physics_steps;
+
+	// Same order as begin_step, with the recorded spawn instead of a coin flip
+	std::fill(sim.players.v_x.begin(), sim.players.v_x.end(), 0);
+
+	if (idx_step % barrel_spawn_interval == 0) {
+		sim.barrel_buffer.add_element(new_barrel(get_bits(spawns, idx_step / barrel_spawn_interval, 1) != 0));
+	}
+
+	for (size_t idx_agent = 0; idx_agent < agents.size(); idx_agent++) {
+		// Actions after an agent's death only ever touched the dead agent, so any will do
+		step_actions[idx_agent] = (static_cast<uint32_t>(idx_step) < agents[idx_agent].num_actions)
+			? get_bits(actions[idx_agent], static_cast<size_t>(idx_step) * 2, 3) : static_cast<uint32_t>(Action::Left);
+	}
+
+	end_step(sim, level, step_actions);
+
+	return sim.num_physics_steps < header.num_steps;
+}
+
+int Replay_player::num_steps() const {
+	return header.num_steps;
+}
+
+const Sim_state& Replay_player::state() const {
+	return sim;
+}
+
+const Replay_header& Replay_player::get_header() const {
+	return header;
+}
+
+const std::vector<Replay_agent>& Replay_player::get_agents() const {
+	return agents;
+}
+
+void Replay_player::restart() {
+	init_players(sim.players, static_cast<uint32_t>(agents.size()), false, player_width, player_height);
+	init_kill_state(sim.kill_state, sim.players);
+
+	for (size_t idx_agent = 0; idx_agent < agents.size(); idx_agent++) {
+		sim.kill_state.pos_previous_x[idx_agent] = agents[idx_agent].pos_previous_x;
+		sim.kill_state.pos_previous_y[idx_agent] = agents[idx_agent].pos_previous_y;
+	}
+
+	sim.kill_state.last_clear_physics_step = header.last_clear_physics_step;
+	sim.kill_state.last_clear_no_move = header.last_clear_no_move;
+	sim.barrel_buffer.clear();
+	sim.num_physics_steps = 0;
+}
+
+void Replay_player::save_keyframe(Keyframe& keyframe) const {
+	keyframe.players = sim.players;
+	keyframe.barrel_buffer = sim.barrel_buffer;
+	keyframe.kill_state = sim.kill_state;
+	keyframe.num_physics_steps = sim.num_physics_steps;
+}
+
+void Replay_player::load_keyframe(const Keyframe& keyframe) {
+	sim.players = keyframe.players;
+	sim.barrel_buffer = keyframe.barrel_buffer;
+	sim.kill_state = keyframe.kill_state;
+	sim.num_physics_steps = keyframe.num_physics_steps;
+}
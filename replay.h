@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <simulation.h>
+
+constexpr uint32_t replay_version = 1;
+// Steps between the states Replay_player keeps for seeking
+constexpr int replay_keyframe_interval = 250;
+
+// Start of a replay file. Agents never affect each other or the barrels, so a few agents of a generation
+//	can be re-simulated on their own from their actions, the barrel spawns and the kill heuristics'
+//	starting state. The header is followed by num_agents Replay_agent, then one bit per barrel spawn
+//	(1 rolling right), then per agent its Action for each step it started alive, 2 bits each. Bits are
+//	packed from the lowest bit of each byte up, and every agent's actions start on a new byte.
+struct Replay_header {
+	char magic[8] = { 'D', 'O', 'N', 'K', 'E', 'Y', 'R', 'P' };
+	uint32_t version = replay_version;
+	uint32_t header_size = sizeof(Replay_header);
+	int32_t generation = {};
+	// Length of the generation the agents were recorded in
+	int32_t num_steps = {};
+	uint32_t num_agents = {};
+	uint32_t num_spawns = {};
+	int32_t initial_jump_size = {};
+	int32_t last_clear_physics_step = {};
+	int32_t last_clear_no_move = {};
+	uint32_t reserved = {};
+};
+
+struct Replay_agent {
+	// Index in the recorded population
+	uint32_t idx_agent = {};
+	uint32_t num_actions = {};
+	int32_t pos_previous_x = {};
+	int32_t pos_previous_y = {};
+	// Outcome of the recorded run, to check a re-simulation against
+	int32_t score = {};
+	int32_t level = {};
+};
+
+// Records a whole single-episode generation, every agent's actions packed as it is stepped, so the
+//	agents worth keeping can be picked once the generation is over. Buffers are reused between generations.
+class Replay_recorder {
+public:
+	// Before the first step of a generation
+	void begin(const Sim_state& sim);
+	// After every step, including the one that ended the generation
+	void record_step(const Sim_state& sim);
+	// Writes agents idx_agents of the recorded generation to path. False if the file could not be written.
+	bool write(const std::string& path, std::span<const uint32_t> idx_agents, const Sim_state& sim) const;
+private:
+	uint8_t action(uint32_t idx_step, uint32_t idx_agent) const;
+
+	Replay_header header = {};
+	uint32_t num_agents = {};
+	uint32_t bytes_per_step = {};
+	// Step-major, num_agents 2-bit actions per step
+	std::vector<uint8_t> actions = {};
+	std::vector<uint8_t> spawns = {};
+	// Steps each agent started alive, and whether it still is
+	std::vector<uint32_t> num_actions = {};
+	std::vector<uint8_t> recording = {};
+	std::vector<int> pos_previous_x = {};
+	std::vector<int> pos_previous_y = {};
+};
+
+// Re-simulates a replay file. Keeps the state every replay_keyframe_interval steps, so seeking
+//	anywhere only steps forward from the nearest keyframe before it.
+class Replay_player {
+public:
+	// Prints the reason and returns false if the file cannot be used
+	bool load(const std::string& path, const Level& level);
+	// Rewinds or fast-forwards to the state after idx_step steps
+	void seek(const Level& level, int idx_step);
+	// False once the recorded generation is over
+	bool step(const Level& level);
+	int num_steps() const;
+	const Sim_state& state() const;
+	const Replay_header& get_header() const;
+	const std::vector<Replay_agent>& get_agents() const;
+private:
+	struct Keyframe {
+		Player_store players = {};
+		Barrel_buffer barrel_buffer = Barrel_buffer(1, barrel_width, barrel_height);
+		Kill_state kill_state = {};
+		int num_physics_steps = {};
+	};
+
+	void restart();
+	void save_keyframe(Keyframe& keyframe) const;
+	void load_keyframe(const Keyframe& keyframe);
+
+	Replay_header header = {};
+	std::vector<Replay_agent> agents = {};
+	std::vector<uint8_t> spawns = {};
+	// actions[idx_agent] packed 2 bits per step
+	std::vector<std::vector<uint8_t>> actions = {};
+	std::vector<uint32_t> step_actions = {};
+	std::vector<Keyframe> keyframes = {};
+	Sim_state sim = {};
+};
@@ -0,0 +1,130 @@
+#include <algorithm>
+#include <iostream>
+
+#include <sim_thread.h>
+
+namespace {
+	// Snapshots are published at most this often, so an unlimited sim does not spend its time copying
+	constexpr auto publish_interval = std::chrono::microseconds(4000);
+	// A sim further behind than this drops the backlog instead of catching up in one burst
+	constexpr auto max_lag = std::chrono::milliseconds(250);
+}
+
+Sim_thread::Sim_thread(Sim_state& sim, const Level& level, float speed) : sim(sim), level(level), speed(speed) {
+	// A first snapshot so the renderer has something to draw before the first publish
+	publish();
+	thread = std::thread(&Sim_thread::run, this);
+}
+
+Sim_thread::~Sim_thread() {
+	stop = true;
+	thread.join();
+}
+
+void Sim_thread::set_speed(float new_speed) {
+	speed.store(new_speed, std::memory_order_relaxed);
+}
+
+void Sim_thread::set_human_input(uint32_t action_bits) {
+	human_input.store(action_bits, std::memory_order_relaxed);
+}
+
+const Sim_snapshot& Sim_thread::latest_snapshot() {
+	return snapshots.read();
+}
+
+#ifdef DONKEY_PROFILE
+bool Sim_thread::open_profile(const std::string& path) {
+	if (is_profiling || !profile_report.open(path)) {
+		return false;
+	}
+
+	is_profiling.store(true, std::memory_order_release);
+
+	return true;
+}
+#endif
+
+void Sim_thread::run() {
+	auto time_next_step = std::chrono::steady_clock::now();
+	auto time_last_publish = time_next_step;
+
+	time_generation_start = time_next_step;
+
+	while (!stop.load(std::memory_order_relaxed)) {
+		auto cur_speed = speed.load(std::memory_order_relaxed);
+		auto time_now = std::chrono::steady_clock::now();
+
+		if (cur_speed != sim_speed_unlimited) {
+			if (time_now < time_next_step) {
+				std::this_thread::sleep_until(time_next_step);
+				continue;
+			}
+
+			time_next_step = std::max(time_next_step, time_now - max_lag)
+				+ std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / (settings.game.physics_update_rate_hz * cur_speed)));
+		}
+
+		step_once();
+
+		if (time_now - time_last_publish >= publish_interval) {
+			publish();
+			time_last_publish = time_now;
+		}
+	}
+}
+
+void Sim_thread::step_once() {
+	auto any_alive = false;
+
+	begin_step(sim, level);
+
+	if (sim.is_human) {
+		auto action_bits = human_input.load(std::memory_order_relaxed);
+
+		if (action_bits & (1u << static_cast<uint32_t>(Action::Left))) {
+			move_left(sim.players, 0);
+		}
+		if (action_bits & (1u << static_cast<uint32_t>(Action::Right))) {
+			move_right(sim.players, 0);
+		}
+		if (action_bits & (1u << static_cast<uint32_t>(Action::Jump))) {
+			jump(sim.players, 0);
+		}
+
+		any_alive = end_step(sim, level, {});
+	}
+	else {
+		choose_actions(sim);
+		any_alive = end_step(sim, level, sim.batch_actions);
+	}
+
+	if (any_alive) {
+		return;
+	}
+
+	std::cout << "===\nDone with generation " << sim.generation << std::endl;
+	next_generation(sim);
+	std::cout << "===\n";
+
+#ifdef DONKEY_PROFILE
+	auto time_now = std::chrono::steady_clock::now();
+
+	if (is_profiling.load(std::memory_order_acquire)) {
+		profile_report.write(sim.generation - 1, std::chrono::duration<double>(time_now - time_generation_start).count(), profile_collect());
+	}
+
+	time_generation_start = time_now;
+#endif
+}
+
+void Sim_thread::publish() {
+	auto& snapshot = snapshots.write_slot();
+
+	// Assigning into the slot's vectors reuses their capacity, so after the first few publishes this does not allocate
+	snapshot.players = sim.players;
+	snapshot.barrels = sim.barrel_buffer.elements;
+	snapshot.num_physics_steps = sim.num_physics_steps;
+	snapshot.generation = sim.generation;
+	snapshots.publish();
+}
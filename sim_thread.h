@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+#include <profile.h>
+#include <simulation.h>
+#include <triple_buffer.h>
+
+// Speed multiplier that steps as fast as the CPU allows
+constexpr float sim_speed_unlimited = 0.0f;
+
+// What a renderer needs of a Sim_state
+struct Sim_snapshot {
+	Player_store players = {};
+	Entity_store barrels = {};
+	int num_physics_steps = 0;
+	int generation = 1;
+};
+
+// Steps a Sim_state on its own thread, a new generation whenever every agent is dead, and publishes
+//	snapshots of it for another thread to draw. The Sim_state must not be touched while this exists.
+class Sim_thread {
+public:
+	// Starts stepping at speed times physics_update_rate_hz
+	Sim_thread(Sim_state& sim, const Level& level, float speed = 1.0f);
+	// Stops after the step in progress
+	~Sim_thread();
+	Sim_thread(const Sim_thread&) = delete;
+	Sim_thread& operator=(const Sim_thread&) = delete;
+
+	// Multiple of physics_update_rate_hz, or sim_speed_unlimited
+	void set_speed(float speed);
+	// Keys held by a human player as bits 1 << Action, applied from the next step on
+	void set_human_input(uint32_t action_bits);
+	// Newest snapshot. Only call from one thread; the reference stays valid until the next call.
+	const Sim_snapshot& latest_snapshot();
+
+#ifdef DONKEY_PROFILE
+	// Writes a profile report row at the end of every generation from now on
+	bool open_profile(const std::string& path);
+#endif
+private:
+	void run();
+	void step_once();
+	void publish();
+
+	Sim_state& sim;
+	const Level& level;
+	Triple_buffer<Sim_snapshot> snapshots = {};
+	std::atomic<float> speed = 1.0f;
+	std::atomic<uint32_t> human_input = 0;
+	std::atomic<bool> stop = false;
+	std::chrono::steady_clock::time_point time_generation_start = {};
+#ifdef DONKEY_PROFILE
+	Profile_report profile_report = {};
+	std::atomic<bool> is_profiling = false;
+#endif
+	std::thread thread = {};
+};
@@ -0,0 +1,1088 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <iostream>
+#include <numbers>
+#include <span>
+#include <unordered_map>
+
+#include <profile.h>
+#include <replay.h>
+#include <simulation.h>
+
+Settings settings = Settings{ };
+
+constexpr uint32_t agents_per_chunk = 32;
+
+// Runs fn over chunks of [0, count) on the thread pool if there is one. Each agent only reads shared level/barrel
+//	state and writes to itself, so the result does not depend on how the agents are split up.
+void for_each_range(Sim_state& sim, uint32_t count, const Thread_pool::Range_function& fn) {
+	if (sim.thread_pool) {
+		sim.thread_pool->parallel_for(count, agents_per_chunk, fn);
+	}
+	else {
+		fn(0, count, 0);
+	}
+}
+
+// fn gets ranges of positions in players.alive_indices
+void for_each_alive_range(Sim_state& sim, const Thread_pool::Range_function& fn) {
+	for_each_range(sim, static_cast<uint32_t>(sim.players.alive_indices.size()), fn);
+}
+
+std::span<const uint32_t> alive_subspan(const Sim_state& sim, uint32_t idx_alive_begin, uint32_t idx_alive_end) {
+	return std::span<const uint32_t>(sim.players.alive_indices).subspan(idx_alive_begin, idx_alive_end - idx_alive_begin);
+}
+
+void Entity_store::reserve(size_t count) {
+	offset_x.reserve(count);
+	offset_y.reserve(count);
+	v_x.reserve(count);
+	v_y.reserve(count);
+	level.reserve(count);
+	is_on_ground.reserve(count);
+	alive.reserve(count);
+	ground_y.reserve(count);
+}
+
+void Entity_store::resize(size_t count) {
+	offset_x.resize(count);
+	offset_y.resize(count);
+	v_x.resize(count);
+	v_y.resize(count);
+	level.resize(count);
+	is_on_ground.resize(count);
+	alive.resize(count);
+	ground_y.resize(count);
+}
+
+void Entity_store::set(uint32_t idx, const Entity& entity) {
+	offset_x[idx] = entity.offset_x;
+	offset_y[idx] = entity.offset_y;
+	v_x[idx] = entity.v_x;
+	v_y[idx] = entity.v_y;
+	level[idx] = entity.level;
+	is_on_ground[idx] = entity.is_on_ground;
+}
+
+void Player_store::resize(size_t count) {
+	Entity_store::resize(count);
+	score.resize(count);
+	dead_at_step.resize(count);
+}
+
+void Player_store::compact_alive() {
+	std::erase_if(alive_indices, [&](uint32_t idx_player) {
+		if (alive[idx_player]) {
+			return false;
+		}
+
+		recently_dead.push_back(idx_player);
+		return true;
+		});
+}
+
+void init_sim_state(Sim_state& sim, uint64_t seed, Thread_pool* thread_pool, bool is_human) {
+	auto num_workers = thread_pool ? thread_pool->num_workers() : 1;
+
+	sim.thread_pool = thread_pool;
+	sim.is_human = is_human;
+	sim.neural_nets.clear();
+
+	for (uint32_t idx_worker = 0; idx_worker < num_workers; idx_worker++) {
+		sim.neural_nets.push_back(Neural_net(settings.brain.num_inputs, settings.brain.num_hidden, settings.brain.num_outputs));
+	}
+
+	sim.fixed_barrel_seed = Random::stream(seed, random_stream_fixed_barrels).next();
+	sim.genetic_algorithm = std::make_unique<Genetic_algorithm>(settings.game.num_agents, settings.brain.num_weights,
+		Random::stream(seed, random_stream_genetic_algorithm), settings.game.population_path);
+	pack_population_weights(sim);
+	init_env_state(sim, seed, is_human);
+}
+
+void init_env_state(Sim_state& sim, uint64_t seed, bool is_human) {
+	sim.barrel_random = Random::stream(seed, random_stream_barrels);
+	init_players(sim.players, settings.game.num_agents, is_human, player_width, player_height);
+	init_kill_state(sim.kill_state, sim.players);
+	sim.barrel_buffer.clear();
+	sim.num_physics_steps = 0;
+	sim.generation = 1;
+}
+
+std::vector<Line_segment> generate_level(int num_squares_x) {
+	auto line_segments = std::vector<Line_segment>();
+
+	line_segments.push_back({
+		-3 * 8, 9 * 8,
+		3 * 8, 9 * 8 });
+
+	line_segments.push_back({
+		-(num_squares_x / 2) * 8, 5 * 8 + 4,
+		4 * 8, 5 * 8 + 4 });
+
+	auto generate_line_vertices = [&line_segments](uint32_t num_blocks, int x_offset, int y_offset, int x_factor) {
+		for (auto idx_block = 0; idx_block < (int)num_blocks; idx_block++) {
+			int pix_x_start = x_offset + 8 * (x_factor * 2 * idx_block);
+			int pix_x_end = x_offset + 8 * (x_factor * 2 * (idx_block + 1));
+			int pix_y_start = y_offset - idx_block;
+			int pix_y_end = pix_y_start;
+			line_segments.push_back({
+				pix_x_start, pix_y_start,
+				pix_x_end, pix_y_end });
+		}
+		};
+
+	generate_line_vertices(4, 4 * 8, 5 * 8 + 3, 1);
+	generate_line_vertices(13, 8 * num_squares_x / 2, 8 * 2 + 3, -1);
+	generate_line_vertices(13, -8 * num_squares_x / 2, -8 * 1 - 6, 1);
+	generate_line_vertices(13, 8 * num_squares_x / 2, -8 * 5 - 6, -1);
+	generate_line_vertices(13, -8 * num_squares_x / 2, -8 * 10, 1);
+	generate_line_vertices(7, 8 * num_squares_x / 2, -8 * 14 - 2, -1);
+
+	line_segments.push_back({
+		(-num_squares_x / 2) * 8, -8 * 15,
+		0, -8 * 15 });
+
+	return line_segments;
+}
+
+void Barrel_broad_phase::build(const Entity_store& barrels) {
+	bounds.clear();
+	max_width = 2 * (barrels.width / 2);
+
+	for (size_t idx_barrel = 0; idx_barrel < barrels.size(); idx_barrel++) {
+		bounds.push_back({
+			barrels.offset_x[idx_barrel] - barrels.width / 2, barrels.offset_x[idx_barrel] + barrels.width / 2,
+			barrels.offset_y[idx_barrel] - barrels.height / 2, barrels.offset_y[idx_barrel] + barrels.height / 2 });
+	}
+
+	std::sort(bounds.begin(), bounds.end(), [](const Bounds& a, const Bounds& b) { return a.x_min < b.x_min; });
+}
+
+bool Barrel_broad_phase::overlaps(int x, int y) const {
+	// Barrels starting right of x cannot cover it, and neither can ones starting more than max_width to the left
+	auto it = std::upper_bound(bounds.begin(), bounds.end(), x, [](int value, const Bounds& b) { return value < b.x_min; });
+
+	while (it != bounds.begin()) {
+		--it;
+
+		if (it->x_min < x - max_width) {
+			break;
+		}
+
+		if ((x <= it->x_max) && (y >= it->y_min) && (y <= it->y_max)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Landing query for entity idx, the one part of physics that looks at level geometry. Airborne
+//	entities moving up cannot land and skip the query.
+void find_ground(Entity_store& entities, const Level& level, uint32_t idx) {
+	auto half_width = entities.width / 2;
+	auto half_height = entities.height / 2;
+	auto is_on_ground = entities.is_on_ground[idx];
+	auto bottom = entities.offset_y[idx] - half_height;
+	auto line_segment_collision = static_cast<const Line_segment*>(nullptr);
+
+	if (entities.alive[idx] && (is_on_ground || (entities.v_y[idx] < 0))) {
+		auto y_after = is_on_ground ? (bottom - 1) : (bottom + entities.v_y[idx]);
+		auto x = entities.offset_x[idx];
+		line_segment_collision = level.get_collision_line_segment(x - half_width, x + half_width, bottom + 2, y_after);
+	}
+
+	entities.ground_y[idx] = line_segment_collision ? line_segment_collision->y_start : Entity_store::no_ground;
+}
+
+// Landing queries for [idx_begin, idx_end)
+void find_ground(Entity_store& entities, const Level& level, uint32_t idx_begin, uint32_t idx_end) {
+	for (auto idx = idx_begin; idx < idx_end; idx++) {
+		find_ground(entities, level, idx);
+	}
+}
+
+// Gravity, landing and wall clamping for count entities after find_ground. Every branch of the per-entity
+//	version is a blend on a 0/1 mask here, so the loop vectorizes; the arrays are parameters because
+//	__restrict is only honoured there, and without it there are too many alias checks to vectorize.
+//	Dead entities keep their state. With bounce, hitting a wall flips v_x.
+void integrate_arrays(uint32_t count, int half_height, int bounce, int* __restrict offset_x, int* __restrict offset_y,
+	int* __restrict v_x, int* __restrict v_y, int* __restrict level, uint8_t* __restrict is_on_ground,
+	const uint8_t* __restrict alive, const int* __restrict ground_y) {
+	constexpr auto max_x = 14 * 8;
+
+	for (uint32_t idx = 0; idx < count; idx++) {
+		int live = alive[idx];
+		int landed = (ground_y[idx] != Entity_store::no_ground);
+		int was_on_ground = is_on_ground[idx];
+		int falling = 1 - landed;
+		auto y = offset_y[idx];
+		auto vy = v_y[idx];
+
+		// Landing snaps to the segment and stops; walking off an edge starts the fall at -1
+		y = landed * (ground_y[idx] + half_height) + falling * y;
+		vy = falling * (was_on_ground * -1 + (1 - was_on_ground) * vy);
+		y += falling * vy;
+		vy -= falling;
+
+		// Level thresholds are ascending, so the number passed is the level
+		auto level_landed = (y >= -92) + (y >= -57) + (y >= -26) + (y >= 6) + (y >= 39);
+		auto x = std::clamp(offset_x[idx] + v_x[idx], -max_x, max_x);
+		int hit_wall = (x == offset_x[idx]) & (v_x[idx] != 0);
+		auto vx = v_x[idx] * (1 - 2 * (hit_wall & bounce));
+		int relevel = live & landed;
+
+		offset_y[idx] = live * y + (1 - live) * offset_y[idx];
+		v_y[idx] = live * vy + (1 - live) * v_y[idx];
+		level[idx] = relevel * level_landed + (1 - relevel) * level[idx];
+		is_on_ground[idx] = static_cast<uint8_t>(live * landed + (1 - live) * was_on_ground);
+		offset_x[idx] = live * x + (1 - live) * offset_x[idx];
+		v_x[idx] = live * vx + (1 - live) * v_x[idx];
+	}
+}
+
+void integrate(Entity_store& entities, uint32_t idx_begin, uint32_t idx_end, bool bounce_off_walls) {
+	integrate_arrays(idx_end - idx_begin, entities.height / 2, bounce_off_walls ? 1 : 0,
+		entities.offset_x.data() + idx_begin, entities.offset_y.data() + idx_begin, entities.v_x.data() + idx_begin,
+		entities.v_y.data() + idx_begin, entities.level.data() + idx_begin, entities.is_on_ground.data() + idx_begin,
+		entities.alive.data() + idx_begin, entities.ground_y.data() + idx_begin);
+}
+
+// Entities at ascending indices, after find_ground on each. While they fill at least half of the span
+//	they cover, the whole span goes through the vector loop, where the dead ones in between keep their
+//	state. Sparser sets are integrated one by one, so their cost follows the number of entities.
+void integrate(Entity_store& entities, std::span<const uint32_t> indices, bool bounce_off_walls) {
+	if (indices.empty()) {
+		return;
+	}
+
+	auto idx_first = indices.front();
+	auto idx_last = indices.back();
+
+	if (idx_last - idx_first + 1 <= 2 * indices.size()) {
+		integrate(entities, idx_first, idx_last + 1, bounce_off_walls);
+		return;
+	}
+
+	for (auto idx : indices) {
+		integrate(entities, idx, idx + 1, bounce_off_walls);
+	}
+}
+
+void physics(Sim_state& sim, const Level& level) {
+	auto& players = sim.players;
+	auto& barrels = sim.barrel_buffer.elements;
+	auto num_physics_steps = sim.num_physics_steps;
+	auto num_barrels = static_cast<uint32_t>(barrels.size());
+
+	// Chunks of the sorted alive list cover disjoint index spans, so chunks never touch the same agent
+	for_each_alive_range(sim, [&](uint32_t idx_alive_begin, uint32_t idx_alive_end, uint32_t) {
+		auto idx_players = alive_subspan(sim, idx_alive_begin, idx_alive_end);
+
+		for (auto idx_player : idx_players) {
+			find_ground(players, level, idx_player);
+		}
+
+		integrate(players, idx_players, false);
+		});
+
+	find_ground(barrels, level, 0, num_barrels);
+	integrate(barrels, 0, num_barrels, true);
+	sim.barrel_broad_phase.build(barrels);
+
+	for_each_alive_range(sim, [&](uint32_t idx_alive_begin, uint32_t idx_alive_end, uint32_t) {
+		for (auto idx_player : alive_subspan(sim, idx_alive_begin, idx_alive_end)) {
+			if (!players.is_on_ground[idx_player]) {
+				// TODO: Think we should always be alive if we are in the air?
+				continue;
+			}
+			if (sim.barrel_broad_phase.overlaps(players.offset_x[idx_player], players.offset_y[idx_player])) {
+				players.alive[idx_player] = 0;
+				players.dead_at_step[idx_player] = num_physics_steps;
+				// TODO: We assume the last line segment is the one at the bottom of the board.
+				//	Should be an alright assumption
+				players.score[idx_player] = players.offset_y[idx_player] - level.line_segments.back().y_end;
+			}
+		}
+		});
+}
+
+void jump(Player_store& players, uint32_t idx_player) {
+	if (!players.is_on_ground[idx_player]) {
+		return;
+	}
+
+	players.v_y[idx_player] = settings.game.initial_jump_size;
+	players.is_on_ground[idx_player] = 0;
+}
+
+void move_left(Player_store& players, uint32_t idx_player) {
+	players.v_x[idx_player] = -1;
+}
+
+void move_right(Player_store& players, uint32_t idx_player) {
+	players.v_x[idx_player] = 1;
+}
+
+void pack_population_weights(Sim_state& sim) {
+	auto& population = sim.genetic_algorithm->population;
+	auto& packer = sim.neural_nets.front();
+
+	// Blocks pack their own genomes as they are played
+	if (sim.evaluation.agents_per_block > 0) {
+		sim.batch_weights = Batch_weights();
+		return;
+	}
+
+	packer.init_batch_weights(sim.batch_weights, static_cast<uint32_t>(population.size()), sim.evaluation.weight_precision);
+
+	for (size_t idx_genome = 0; idx_genome < population.size(); idx_genome++) {
+		packer.set_batch_genome(sim.batch_weights, static_cast<uint32_t>(idx_genome), population[idx_genome].weights);
+	}
+}
+
+// Sensor readings of agents idx_players into sim.batch_inputs
+void observe(Sim_state& sim, const Level& level, std::span<const uint32_t> idx_players) {
+	auto& players = sim.players;
+	auto& barrels = sim.barrel_buffer.elements;
+	auto& batch_inputs = sim.batch_inputs;
+	auto num_agents = static_cast<uint32_t>(players.size());
+
+	for (auto idx_player : idx_players) {
+		auto player_x = players.offset_x[idx_player];
+		auto player_y = players.offset_y[idx_player];
+		auto distance_ceiling = (float)level.get_ceiling_distance(player_x, player_y, 100);
+		auto player_level = (float)players.level[idx_player];
+
+		struct Barrel_distance {
+			float angle = 0.0f;
+			float distance = 0.0f;
+		};
+
+		auto barrel_distances = std::array<Barrel_distance, 2>();
+
+		for (auto& barrel_distance : barrel_distances) {
+			barrel_distance.distance = 100.0f;
+		}
+
+		auto idx_cur_worst = 0;
+
+		for (size_t idx_barrel = 0; idx_barrel < barrels.size(); idx_barrel++) {
+			auto barrel_x = barrels.offset_x[idx_barrel];
+			auto barrel_y = barrels.offset_y[idx_barrel];
+			auto distance = std::hypot((float)barrel_x - player_x, (float)barrel_y - player_y);
+
+			if (distance < barrel_distances[idx_cur_worst].distance) {
+				auto angle = std::atan2((float)barrel_y - player_y, (float)barrel_x - player_x);
+				auto new_barrel_distance = Barrel_distance();
+				new_barrel_distance.angle = angle;
+				new_barrel_distance.distance = distance;
+				barrel_distances[idx_cur_worst] = new_barrel_distance;
+			}
+		}
+
+		auto is_on_ground = (players.is_on_ground[idx_player] ? 1.0f : 0.0f);
+
+		// Normalizing
+		auto player_offset_x = player_x / 100.0f;
+		auto player_offset_y = player_y / 100.0f;
+		player_level /= 5;
+
+		for (auto& barrel_distance : barrel_distances) {
+			barrel_distance.angle /= std::numbers::pi_v<float>;
+			barrel_distance.distance /= 100.0f;
+		}
+
+		distance_ceiling /= 100.0f;
+
+		auto inputs = std::array<float, 9>{
+			is_on_ground,
+			player_offset_x,
+			player_offset_y,
+			player_level,
+			barrel_distances[0].distance,
+			barrel_distances[0].angle,
+			barrel_distances[1].distance,
+			barrel_distances[1].angle,
+			distance_ceiling
+		};
+
+		for (size_t idx_input = 0; idx_input < inputs.size(); idx_input++) {
+			batch_inputs[idx_input * num_agents + idx_player] = inputs[idx_input];
+		}
+	}
+}
+
+void apply_actions(Sim_state& sim, std::span<const uint32_t> actions, std::span<const uint32_t> idx_players) {
+	for (auto idx_player : idx_players) {
+		auto action = static_cast<Action>(actions[idx_player]);
+
+		switch (action) {
+		case Action::Jump: jump(sim.players, idx_player); break;
+		case Action::Left: move_left(sim.players, idx_player); break;
+		case Action::Right: move_right(sim.players, idx_player); break;
+		}
+	}
+}
+
+void begin_step(Sim_state& sim, const Level& level) {
+	auto num_agents = static_cast<uint32_t>(sim.players.size());
+
+	sim.batch_inputs.resize(static_cast<size_t>(settings.brain.num_inputs) * num_agents);
+	for (auto idx_player : sim.players.alive_indices) {
+		sim.players.v_x[idx_player] = 0;
+	}
+
+	{
+		DONKEY_PROFILE_SCOPE(Game_logics);
+		game_logics(sim);
+	}
+
+	DONKEY_PROFILE_SCOPE(Observe);
+
+	for_each_alive_range(sim, [&](uint32_t idx_alive_begin, uint32_t idx_alive_end, uint32_t) {
+		observe(sim, level, alive_subspan(sim, idx_alive_begin, idx_alive_end));
+		});
+}
+
+// The weights the networks play
+const Batch_weights& played_weights(const Sim_state& sim) {
+	return sim.shared_batch_weights ? *sim.shared_batch_weights : sim.batch_weights;
+}
+
+// The survivors' columns of the played weights, in consecutive lanes
+void pack_alive_weights(Sim_state& sim) {
+	sim.packed_agents.assign(sim.players.alive_indices.begin(), sim.players.alive_indices.end());
+	gather_batch_genomes(played_weights(sim), sim.packed_agents, sim.packed_weights);
+}
+
+void choose_actions(Sim_state& sim) {
+	DONKEY_PROFILE_SCOPE(Brain_run);
+	auto num_agents = static_cast<uint32_t>(sim.players.size());
+	auto num_alive = sim.players.alive_indices.size();
+
+	sim.batch_actions.resize(num_agents);
+
+	// A new generation starts with every agent in its own lane
+	if (sim.num_physics_steps == 0) {
+		sim.packed_agents.clear();
+	}
+
+	if (sim.packed_agents.empty() && (num_alive * 2 > num_agents)) {
+		for_each_range(sim, num_agents, [&](uint32_t idx_begin, uint32_t idx_end, uint32_t idx_worker) {
+			if (!sim.neural_nets[idx_worker].forward_batch(sim.batch_inputs.data(), num_agents, played_weights(sim), idx_begin, idx_end, sim.batch_actions.data())) {
+				std::cout << "Could not feed-forward\n";
+			}
+			});
+		return;
+	}
+
+	// Repacking only when half the lanes are dead keeps its cost to about one packing per generation
+	if (sim.packed_agents.empty() || (num_alive * 2 <= sim.packed_agents.size())) {
+		pack_alive_weights(sim);
+	}
+
+	auto num_packed = static_cast<uint32_t>(sim.packed_agents.size());
+	auto num_inputs = static_cast<uint32_t>(settings.brain.num_inputs);
+
+	sim.packed_inputs.resize(static_cast<size_t>(num_inputs) * num_packed);
+	sim.packed_actions.resize(num_packed);
+
+	// Lanes of agents that died since the packing compute actions nobody reads
+	for_each_range(sim, num_packed, [&](uint32_t idx_lane_begin, uint32_t idx_lane_end, uint32_t idx_worker) {
+		for (uint32_t idx_input = 0; idx_input < num_inputs; idx_input++) {
+			auto inputs = sim.batch_inputs.data() + static_cast<size_t>(idx_input) * num_agents;
+			auto packed = sim.packed_inputs.data() + static_cast<size_t>(idx_input) * num_packed;
+
+			for (auto idx_lane = idx_lane_begin; idx_lane < idx_lane_end; idx_lane++) {
+				packed[idx_lane] = inputs[sim.packed_agents[idx_lane]];
+			}
+		}
+
+		if (!sim.neural_nets[idx_worker].forward_batch(sim.packed_inputs.data(), num_packed, sim.packed_weights, idx_lane_begin, idx_lane_end, sim.packed_actions.data())) {
+			std::cout << "Could not feed-forward\n";
+		}
+
+		for (auto idx_lane = idx_lane_begin; idx_lane < idx_lane_end; idx_lane++) {
+			sim.batch_actions[sim.packed_agents[idx_lane]] = sim.packed_actions[idx_lane];
+		}
+		});
+}
+
+bool end_step(Sim_state& sim, const Level& level, std::span<const uint32_t> actions) {
+	if (!actions.empty()) {
+		for_each_alive_range(sim, [&](uint32_t idx_alive_begin, uint32_t idx_alive_end, uint32_t) {
+			apply_actions(sim, actions, alive_subspan(sim, idx_alive_begin, idx_alive_end));
+			});
+	}
+
+	{
+		DONKEY_PROFILE_SCOPE(Physics);
+		physics(sim, level);
+	}
+
+	sim.num_physics_steps++;
+
+	if (!sim.is_human) {
+		DONKEY_PROFILE_SCOPE(Kill_agents);
+		kill_agents(sim);
+	}
+
+	sim.players.compact_alive();
+
+	auto num_alive = count_alive(sim.players);
+
+	DONKEY_PROFILE_STEP(num_alive);
+
+	return num_alive > 0;
+}
+
+void brain_update(Sim_state& sim) {
+	DONKEY_PROFILE_SCOPE(Brain_update);
+	auto& players = sim.players;
+	auto& population = sim.genetic_algorithm->population;
+	auto best_level = 0;
+	auto best_score = 0.0f;
+	auto num_agents = players.size();
+
+	if (uses_episodes(sim.evaluation)) {
+		for (size_t idx_agent = 0; idx_agent < num_agents; idx_agent++) {
+			population[idx_agent].fitness = sim.episode_fitness[idx_agent];
+			best_score = std::max(best_score, sim.episode_fitness[idx_agent]);
+		}
+
+		best_level = sim.episode_best_level;
+	}
+	else {
+		for (size_t idx_agent = 0; idx_agent < num_agents; idx_agent++) {
+			population[idx_agent].fitness = (float)players.score[idx_agent];
+			best_level = std::max(best_level, players.level[idx_agent]);
+			best_score = std::max(best_score, (float)players.score[idx_agent]);
+		}
+	}
+
+	sim.best_level = best_level;
+	sim.best_score = best_score;
+	sim.best_level_overall = std::max(sim.best_level_overall, best_level);
+	sim.best_score_overall = std::max(sim.best_score_overall, best_score);
+
+	if (sim.verbose) {
+		std::cout << "Best score in generation (best total): " << best_score << " (" << sim.best_score_overall << ")\n";
+		std::cout << "Best level in generation (best total): " << best_level << " (" << sim.best_level_overall << ")\n";
+
+		if (sim.evaluation.fixed_seeds && sim.evaluation.cache_fitness) {
+			std::cout << "Genomes not played (cached, copies): " << sim.num_fitness_cached + sim.num_fitness_copied
+				<< " (" << sim.num_fitness_cached << ", " << sim.num_fitness_copied << ")\n";
+		}
+	}
+
+	{
+		DONKEY_PROFILE_SCOPE(New_generation);
+		sim.genetic_algorithm->new_generation();
+	}
+
+	pack_population_weights(sim);
+}
+
+Entity new_barrel(bool rolling_right) {
+	auto barrel = Entity();
+
+	barrel.is_on_ground = false;
+	barrel.offset_y = 100;
+	barrel.offset_x = 0;
+	barrel.v_x = rolling_right ? 2 : -2;
+
+	return barrel;
+}
+
+void spawn_barrel(Sim_state& sim) {
+	sim.barrel_buffer.add_element(new_barrel(sim.barrel_random.coin()));
+}
+
+void game_logics(Sim_state& sim) {
+	if (sim.num_physics_steps % barrel_spawn_interval == 0) {
+		spawn_barrel(sim);
+	}
+}
+
+void init_players(Player_store& players, uint32_t num_agents, bool is_human, int player_width, int player_height) {
+	auto num_players = is_human ? 1 : num_agents;
+
+	players.resize(num_agents);
+	players.width = player_width;
+	players.height = player_height;
+
+	for (uint32_t idx_player = 0; idx_player < num_players; idx_player++) {
+		auto player = Entity();
+		player.offset_x = -50;
+		player.offset_y = -100;
+		players.set(idx_player, player);
+		players.alive[idx_player] = 1;
+		players.score[idx_player] = 0;
+		players.dead_at_step[idx_player] = 0;
+	}
+
+	players.alive_indices.clear();
+	players.recently_dead.clear();
+
+	for (uint32_t idx_player = 0; idx_player < num_players; idx_player++) {
+		players.alive_indices.push_back(idx_player);
+	}
+}
+
+void init_kill_state(Kill_state& kill_state, const Player_store& players) {
+	kill_state.pos_previous_x.resize(players.size());
+	kill_state.pos_previous_y.resize(players.size());
+
+	for (size_t idx_player = 0; idx_player < players.size(); idx_player++) {
+		kill_state.pos_previous_x[idx_player] = players.offset_x[idx_player];
+		kill_state.pos_previous_y[idx_player] = players.offset_y[idx_player];
+	}
+}
+
+void kill_agents(Sim_state& sim) {
+	auto& players = sim.players;
+	auto& kill_state = sim.kill_state;
+	auto num_physics_steps = sim.num_physics_steps;
+
+	// Kill of long-running agents that does not move
+	if (num_physics_steps - kill_state.last_clear_physics_step > 2000) {
+		auto min_level = num_physics_steps / 2000;
+
+		if (sim.verbose) {
+			std::cout << "Killing of agents below level " << min_level << std::endl;
+		}
+
+		for (auto idx_player : players.alive_indices) {
+			if (players.level[idx_player] < min_level) {
+				players.alive[idx_player] = 0;
+			}
+		}
+
+		kill_state.last_clear_physics_step = min_level * 2000;
+	}
+
+	// Kill players that do not move. Similar to above, more aggressive
+	if (num_physics_steps - kill_state.last_clear_no_move > 200) {
+		for (auto idx_player : players.alive_indices) {
+			auto prev_x = kill_state.pos_previous_x.data()[idx_player];
+			auto prev_y = kill_state.pos_previous_y.data()[idx_player];
+
+			if (std::hypot((float)players.offset_x[idx_player] - prev_x, (float)players.offset_y[idx_player] - prev_y) < 10.0f) {
+				players.alive[idx_player] = 0;
+			}
+
+			kill_state.pos_previous_x.data()[idx_player] = players.offset_x[idx_player];
+			kill_state.pos_previous_y.data()[idx_player] = players.offset_y[idx_player];
+		}
+
+		// The kill state carries over to the next generation, so agents that died since the last check
+		//	still get their final position recorded, as if they had been checked with the rest
+		for (auto idx_player : players.recently_dead) {
+			kill_state.pos_previous_x.data()[idx_player] = players.offset_x[idx_player];
+			kill_state.pos_previous_y.data()[idx_player] = players.offset_y[idx_player];
+		}
+
+		players.recently_dead.clear();
+
+		kill_state.last_clear_no_move = 200 * (num_physics_steps / 200);
+	}
+}
+
+int count_alive(const Player_store& players) {
+	return static_cast<int>(players.alive_indices.size());
+}
+
+bool step(Sim_state& sim, const Level& level) {
+	begin_step(sim, level);
+	choose_actions(sim);
+
+	return end_step(sim, level, sim.batch_actions);
+}
+
+bool uses_episodes(const Evaluation_settings& evaluation) {
+	return (evaluation.num_episodes > 1) || evaluation.fixed_seeds || (evaluation.agents_per_block > 0);
+}
+
+// Fresh players, kill state and barrels for num_agents agents, on stream idx_episode of barrel_seed
+void init_episode(Sim_state& episode, uint64_t barrel_seed, uint32_t idx_episode, uint32_t num_agents) {
+	episode.barrel_random = Random::stream(barrel_seed, idx_episode);
+	init_players(episode.players, num_agents, false, player_width, player_height);
+	init_kill_state(episode.kill_state, episode.players);
+	episode.kill_state.last_clear_physics_step = 0;
+	episode.kill_state.last_clear_no_move = 0;
+	episode.barrel_buffer.clear();
+	episode.num_physics_steps = 0;
+}
+
+// Blocks of a single episode without fixed seeds play the generation's barrels from barrel_random and
+//	carry the kill state over, like the Sim_state itself. Agents never affect each other, so splitting
+//	the population into blocks then gives the same run as playing it whole.
+bool blocks_carry_over(const Evaluation_settings& evaluation) {
+	return (evaluation.agents_per_block > 0) && (evaluation.num_episodes <= 1) && !evaluation.fixed_seeds;
+}
+
+// Sim_states that play the episodes: one per episode holding every agent, or with blocks one per worker,
+//	reused for every block it plays. Barrels are drawn from one new seed per generation unless the seeds
+//	are fixed or the blocks carry over. Returns the seed.
+uint64_t init_episodes(Sim_state& sim) {
+	auto num_episodes = std::max(sim.evaluation.num_episodes, 1u);
+	auto num_states = (sim.evaluation.agents_per_block > 0) ? static_cast<uint32_t>(sim.neural_nets.size()) : num_episodes;
+	auto barrel_seed = sim.evaluation.fixed_seeds ? sim.fixed_barrel_seed
+		: (blocks_carry_over(sim.evaluation) ? uint64_t{} : sim.barrel_random.next());
+
+	if (sim.episodes.size() != num_states) {
+		sim.episodes.resize(num_states);
+
+		for (auto& episode : sim.episodes) {
+			episode.verbose = false;
+			episode.neural_nets.assign(1, sim.neural_nets[0]);
+		}
+	}
+
+	if (sim.evaluation.agents_per_block > 0) {
+		return barrel_seed;
+	}
+
+	for (uint32_t idx_episode = 0; idx_episode < num_episodes; idx_episode++) {
+		auto& episode = sim.episodes[idx_episode];
+
+		episode.shared_batch_weights = &sim.batch_weights;
+		init_episode(episode, barrel_seed, idx_episode, settings.game.num_agents);
+	}
+
+	return barrel_seed;
+}
+
+// Looks up every genome in the fitness cache and in the genomes before it
+void plan_cached_evaluation(Sim_state& sim, uint64_t barrel_seed, uint32_t num_episodes) {
+	auto& population = sim.genetic_algorithm->population;
+	auto num_agents = static_cast<uint32_t>(sim.players.size());
+	// Episode idx_episode plays stream idx_episode of barrel_seed, so the seed and count are the whole seed set
+	auto seed_set = barrel_seed ^ (static_cast<uint64_t>(num_episodes) << 56);
+	auto first_agents = std::unordered_map<uint64_t, uint32_t>();
+
+	sim.genome_keys.resize(num_agents);
+	sim.fitness_source.resize(num_agents);
+	sim.episode_fitness.resize(num_agents);
+	sim.episode_levels.resize(num_agents);
+	sim.num_fitness_cached = 0;
+	sim.num_fitness_copied = 0;
+
+	for (uint32_t idx_agent = 0; idx_agent < num_agents; idx_agent++) {
+		auto key = Fitness_cache::key(population[idx_agent].weights, seed_set);
+		auto entry = sim.fitness_cache.find(key);
+		auto [first, is_first] = first_agents.try_emplace(key, idx_agent);
+
+		sim.genome_keys[idx_agent] = key;
+
+		if (entry) {
+			sim.fitness_source[idx_agent] = fitness_source_cached;
+			sim.episode_fitness[idx_agent] = entry->fitness;
+			sim.episode_levels[idx_agent] = entry->best_level;
+			sim.num_fitness_cached++;
+		}
+		else {
+			sim.fitness_source[idx_agent] = first->second;
+			sim.num_fitness_copied += is_first ? 0 : 1;
+		}
+	}
+}
+
+// Takes the agents that need not play out of an episode before its first step. The episode's agents
+//	are agents [idx_agent_begin, idx_agent_begin + its size) of the population.
+void sit_out_known_agents(const Sim_state& sim, Sim_state& episode, uint32_t idx_agent_begin) {
+	auto& players = episode.players;
+
+	for (uint32_t idx_player = 0; idx_player < players.size(); idx_player++) {
+		auto idx_agent = idx_agent_begin + idx_player;
+		players.alive[idx_player] = (sim.fitness_source[idx_agent] == idx_agent) ? 1 : 0;
+	}
+
+	std::erase_if(players.alive_indices, [&](uint32_t idx_player) {
+		return !players.alive[idx_player];
+		});
+}
+
+// Where a block ended, for the episode's length and, when blocks carry over, the state carried over
+struct Block_result {
+	int num_physics_steps = 0;
+	Random barrel_random = {};
+	int last_clear_physics_step = 0;
+	int last_clear_no_move = 0;
+	// Agents that died after the block's last no-move check, and where
+	std::vector<uint32_t> idx_unchecked = {};
+	std::vector<int> unchecked_x = {};
+	std::vector<int> unchecked_y = {};
+};
+
+// Plays agents [idx_agent_begin, idx_agent_end) on the barrels of episode idx_episode in the worker's
+//	state, with their weights packed straight from the population, and records their results
+void play_block(Sim_state& sim, Sim_state& state, const Level& level, uint64_t barrel_seed, uint32_t idx_episode,
+	uint32_t idx_agent_begin, uint32_t idx_agent_end, bool is_caching, Block_result& result) {
+	auto& population = sim.genetic_algorithm->population;
+	auto& packer = state.neural_nets.front();
+	auto num_block_agents = idx_agent_end - idx_agent_begin;
+	auto num_agents = static_cast<size_t>(sim.players.size());
+	auto carries_over = blocks_carry_over(sim.evaluation);
+
+	state.shared_batch_weights = nullptr;
+	packer.init_batch_weights(state.batch_weights, num_block_agents, sim.evaluation.weight_precision);
+
+	for (uint32_t idx_player = 0; idx_player < num_block_agents; idx_player++) {
+		packer.set_batch_genome(state.batch_weights, idx_player, population[idx_agent_begin + idx_player].weights);
+	}
+
+	init_episode(state, barrel_seed, idx_episode, num_block_agents);
+
+	if (carries_over) {
+		auto& kill_state = sim.kill_state;
+
+		state.barrel_random = sim.barrel_random;
+		state.kill_state.last_clear_physics_step = kill_state.last_clear_physics_step;
+		state.kill_state.last_clear_no_move = kill_state.last_clear_no_move;
+		std::copy_n(kill_state.pos_previous_x.begin() + idx_agent_begin, num_block_agents, state.kill_state.pos_previous_x.begin());
+		std::copy_n(kill_state.pos_previous_y.begin() + idx_agent_begin, num_block_agents, state.kill_state.pos_previous_y.begin());
+	}
+
+	if (is_caching) {
+		sit_out_known_agents(sim, state, idx_agent_begin);
+	}
+
+	while (!state.players.alive_indices.empty() && step(state, level)) {
+	}
+
+	for (uint32_t idx_player = 0; idx_player < num_block_agents; idx_player++) {
+		sim.episode_score_table[idx_episode * num_agents + idx_agent_begin + idx_player] = (float)state.players.score[idx_player];
+		sim.episode_level_table[idx_episode * num_agents + idx_agent_begin + idx_player] = state.players.level[idx_player];
+	}
+
+	result.num_physics_steps = state.num_physics_steps;
+
+	if (carries_over) {
+		// Blocks write disjoint slices of the kill state
+		std::copy_n(state.kill_state.pos_previous_x.begin(), num_block_agents, sim.kill_state.pos_previous_x.begin() + idx_agent_begin);
+		std::copy_n(state.kill_state.pos_previous_y.begin(), num_block_agents, sim.kill_state.pos_previous_y.begin() + idx_agent_begin);
+		result.barrel_random = state.barrel_random;
+		result.last_clear_physics_step = state.kill_state.last_clear_physics_step;
+		result.last_clear_no_move = state.kill_state.last_clear_no_move;
+		result.idx_unchecked.clear();
+		result.unchecked_x.clear();
+		result.unchecked_y.clear();
+
+		for (auto idx_player : state.players.recently_dead) {
+			result.idx_unchecked.push_back(idx_agent_begin + idx_player);
+			result.unchecked_x.push_back(state.players.offset_x[idx_player]);
+			result.unchecked_y.push_back(state.players.offset_y[idx_player]);
+		}
+	}
+}
+
+// Once every block of a carried-over generation has played: the longest block ends where the whole
+//	population would have, and blocks that ended sooner would still have seen the no-move checks after
+//	them, which record where their last agents died
+void carry_over_blocks(Sim_state& sim, std::span<const Block_result> results) {
+	auto& longest = *std::max_element(results.begin(), results.end(), [](const Block_result& result1, const Block_result& result2) {
+		return result1.num_physics_steps < result2.num_physics_steps;
+		});
+
+	for (auto& result : results) {
+		if (longest.num_physics_steps - result.last_clear_no_move <= 200) {
+			continue;
+		}
+
+		for (size_t idx_unchecked = 0; idx_unchecked < result.idx_unchecked.size(); idx_unchecked++) {
+			sim.kill_state.pos_previous_x[result.idx_unchecked[idx_unchecked]] = result.unchecked_x[idx_unchecked];
+			sim.kill_state.pos_previous_y[result.idx_unchecked[idx_unchecked]] = result.unchecked_y[idx_unchecked];
+		}
+	}
+
+	sim.barrel_random = longest.barrel_random;
+	sim.kill_state.last_clear_physics_step = longest.last_clear_physics_step;
+	sim.kill_state.last_clear_no_move = longest.last_clear_no_move;
+}
+
+float reduce_scores(std::span<float> scores, const Evaluation_settings& evaluation) {
+	switch (evaluation.reduction) {
+	case Fitness_reduction::Mean: {
+		auto sum = 0.0f;
+
+		for (auto score : scores) {
+			sum += score;
+		}
+
+		return sum / scores.size();
+	}
+	case Fitness_reduction::Min:
+		return *std::min_element(scores.begin(), scores.end());
+	case Fitness_reduction::Quantile: {
+		auto idx = static_cast<size_t>(std::clamp(evaluation.quantile, 0.0f, 1.0f) * (scores.size() - 1));
+		std::nth_element(scores.begin(), scores.begin() + idx, scores.end());
+		return scores[idx];
+	}
+	}
+
+	return 0.0f;
+}
+
+int64_t run_generation(Sim_state& sim, const Level& level, Replay_recorder* recorder) {
+	if (!uses_episodes(sim.evaluation)) {
+		if (recorder) {
+			recorder->begin(sim);
+		}
+
+		auto any_alive = true;
+
+		while (any_alive) {
+			any_alive = step(sim, level);
+
+			if (recorder) {
+				recorder->record_step(sim);
+			}
+		}
+
+		return sim.num_physics_steps;
+	}
+
+	auto barrel_seed = init_episodes(sim);
+	auto is_caching = sim.evaluation.fixed_seeds && sim.evaluation.cache_fitness;
+	auto num_episodes = std::max(sim.evaluation.num_episodes, 1u);
+	auto num_agents = static_cast<uint32_t>(sim.players.size());
+	auto agents_per_block = sim.evaluation.agents_per_block;
+	auto num_steps_total = int64_t{};
+
+	sim.episode_score_table.resize(static_cast<size_t>(num_episodes) * num_agents);
+	sim.episode_level_table.resize(static_cast<size_t>(num_episodes) * num_agents);
+	sim.num_physics_steps = 0;
+
+	if (is_caching) {
+		plan_cached_evaluation(sim, barrel_seed, num_episodes);
+	}
+
+	if (agents_per_block > 0) {
+		// Block-major, so a worker taking consecutive tasks plays one block's genomes on every episode
+		auto num_blocks = (num_agents + agents_per_block - 1) / agents_per_block;
+		auto block_results = std::vector<Block_result>(static_cast<size_t>(num_blocks) * num_episodes);
+
+		auto run_blocks = [&](uint32_t idx_begin, uint32_t idx_end, uint32_t idx_worker) {
+			auto& state = sim.episodes[idx_worker];
+
+			for (auto idx_task = idx_begin; idx_task < idx_end; idx_task++) {
+				auto idx_agent_begin = (idx_task / num_episodes) * agents_per_block;
+				auto idx_agent_end = std::min(idx_agent_begin + agents_per_block, num_agents);
+
+				play_block(sim, state, level, barrel_seed, idx_task % num_episodes, idx_agent_begin, idx_agent_end, is_caching, block_results[idx_task]);
+			}
+			};
+
+		if (sim.thread_pool) {
+			sim.thread_pool->parallel_for(num_blocks * num_episodes, 1, run_blocks);
+		}
+		else {
+			run_blocks(0, num_blocks * num_episodes, 0);
+		}
+
+		// An episode lasts as long as its longest block
+		for (uint32_t idx_episode = 0; idx_episode < num_episodes; idx_episode++) {
+			auto num_episode_steps = 0;
+
+			for (uint32_t idx_block = 0; idx_block < num_blocks; idx_block++) {
+				num_episode_steps = std::max(num_episode_steps, block_results[idx_block * num_episodes + idx_episode].num_physics_steps);
+			}
+
+			num_steps_total += num_episode_steps;
+			sim.num_physics_steps = std::max(sim.num_physics_steps, num_episode_steps);
+		}
+
+		if (blocks_carry_over(sim.evaluation)) {
+			carry_over_blocks(sim, block_results);
+		}
+	}
+	else {
+		if (is_caching) {
+			for (auto& episode : sim.episodes) {
+				sit_out_known_agents(sim, episode, 0);
+			}
+		}
+
+		auto run_episodes = [&](uint32_t idx_begin, uint32_t idx_end, uint32_t) {
+			for (auto idx_episode = idx_begin; idx_episode < idx_end; idx_episode++) {
+				auto& episode = sim.episodes[idx_episode];
+
+				// Every agent may be cached
+				while (!episode.players.alive_indices.empty() && step(episode, level)) {
+				}
+			}
+			};
+
+		// Whole episodes per worker: with as many cores as episodes, a generation takes as long as its longest episode
+		if (sim.thread_pool) {
+			sim.thread_pool->parallel_for(num_episodes, 1, run_episodes);
+		}
+		else {
+			run_episodes(0, num_episodes, 0);
+		}
+
+		for (uint32_t idx_episode = 0; idx_episode < num_episodes; idx_episode++) {
+			auto& episode = sim.episodes[idx_episode];
+
+			std::copy(episode.players.score.begin(), episode.players.score.end(), sim.episode_score_table.begin() + static_cast<size_t>(idx_episode) * num_agents);
+			std::copy(episode.players.level.begin(), episode.players.level.end(), sim.episode_level_table.begin() + static_cast<size_t>(idx_episode) * num_agents);
+			sim.num_physics_steps = std::max(sim.num_physics_steps, episode.num_physics_steps);
+			num_steps_total += episode.num_physics_steps;
+		}
+	}
+
+	sim.episode_fitness.resize(num_agents);
+	sim.episode_levels.resize(num_agents);
+	sim.episode_scores.resize(num_episodes);
+	sim.episode_best_level = 0;
+
+	for (uint32_t idx_agent = 0; idx_agent < num_agents; idx_agent++) {
+		if (is_caching && (sim.fitness_source[idx_agent] != idx_agent)) {
+			continue;
+		}
+
+		sim.episode_levels[idx_agent] = 0;
+
+		for (uint32_t idx_episode = 0; idx_episode < num_episodes; idx_episode++) {
+			auto idx = static_cast<size_t>(idx_episode) * num_agents + idx_agent;
+
+			sim.episode_scores[idx_episode] = sim.episode_score_table[idx];
+			sim.episode_levels[idx_agent] = std::max(sim.episode_levels[idx_agent], sim.episode_level_table[idx]);
+		}
+
+		sim.episode_fitness[idx_agent] = reduce_scores(sim.episode_scores, sim.evaluation);
+	}
+
+	for (uint32_t idx_agent = 0; idx_agent < num_agents; idx_agent++) {
+		if (is_caching) {
+			// Copies come after the agent they copy, which has its result by now
+			auto idx_source = sim.fitness_source[idx_agent];
+
+			if ((idx_source != fitness_source_cached) && (idx_source != idx_agent)) {
+				sim.episode_fitness[idx_agent] = sim.episode_fitness[idx_source];
+				sim.episode_levels[idx_agent] = sim.episode_levels[idx_source];
+			}
+
+			sim.fitness_cache.insert(sim.genome_keys[idx_agent], { sim.episode_fitness[idx_agent], sim.episode_levels[idx_agent] });
+		}
+
+		sim.episode_best_level = std::max(sim.episode_best_level, sim.episode_levels[idx_agent]);
+	}
+
+	if (is_caching) {
+		sim.fitness_cache.next_generation();
+	}
+
+	return num_steps_total;
+}
+
+void next_generation(Sim_state& sim) {
+	brain_update(sim);
+	init_players(sim.players, settings.game.num_agents, sim.is_human, player_width, player_height);
+	sim.num_physics_steps = 0;
+	sim.barrel_buffer.clear();
+	sim.generation++;
+}
@@ -0,0 +1,322 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <fitness_cache.h>
+#include <fixed_neural_net.h>
+#include <genetic_algorithm.h>
+#include <level.h>
+#include <neural_net.h>
+#include <random.h>
+#include <thread_pool.h>
+
+enum class Action {
+	Left,
+	Right,
+	Jump
+};
+
+// One entity, for spawning into an Entity_store
+struct Entity {
+	int offset_x = {};
+	int offset_y = {};
+	int v_x = {};
+	int v_y = {};
+	bool is_on_ground = false;
+	int level = 0;
+};
+
+constexpr int player_width = 8;
+constexpr int player_height = 8;
+constexpr int barrel_width = 8;
+constexpr int barrel_height = 8;
+constexpr int barrel_spawn_interval = 100;
+
+// Entities as a structure of arrays, one element per entity in every array, so the physics step can run
+//	down each field with plain integer math. All entities in a store share width and height.
+struct Entity_store {
+	size_t size() const { return offset_x.size(); }
+	void reserve(size_t count);
+	// New entities are zeroed, so not alive
+	void resize(size_t count);
+	void set(uint32_t idx, const Entity& entity);
+
+	int width = {};
+	int height = {};
+	std::vector<int> offset_x = {};
+	std::vector<int> offset_y = {};
+	std::vector<int> v_x = {};
+	std::vector<int> v_y = {};
+	std::vector<int> level = {};
+	std::vector<uint8_t> is_on_ground = {};
+	std::vector<uint8_t> alive = {};
+	// Physics scratch, the height of the segment each entity lands on this step or no_ground
+	std::vector<int> ground_y = {};
+	static constexpr int no_ground = std::numeric_limits<int>::min();
+};
+
+struct Player_store : public Entity_store {
+	void resize(size_t count);
+	// Moves the agents that died since the last call from alive_indices to recently_dead
+	void compact_alive();
+
+	std::vector<int> score = {};
+	std::vector<int> dead_at_step = {};
+	// Living agents, ascending. Per-step passes only visit these. Agents that die during a step stay
+	//	listed, with alive cleared, until end_step compacts the list.
+	std::vector<uint32_t> alive_indices = {};
+	// Dropped from alive_indices since kill_agents last checked for stationary agents, which still
+	//	records where they ended up
+	std::vector<uint32_t> recently_dead = {};
+};
+
+struct Settings {
+	struct Brain {
+		// Brain_neural_net is compiled for these
+		int num_inputs = Brain_neural_net::num_inputs;
+		int num_hidden = Brain_neural_net::num_hidden;
+		int num_outputs = Brain_neural_net::num_outputs;
+		int num_weights = (num_inputs * num_hidden) + (num_hidden * num_outputs); // No biases for simplicity
+	};
+
+	struct Game {
+		int num_agents = 500;
+		int initial_jump_size = 6;
+		float physics_update_rate_hz = 250.0f;
+		// Everything random in a run is derived from this, see random_stream_*
+		uint64_t seed = 0;
+		// When set, init_sim_state keeps the population in this file instead of on the heap
+		std::string population_path = {};
+	};
+
+	struct Gui {
+		int window_width = 800 * 2;
+		int window_height = 600 * 2;
+		int square_size_pixels = 8;
+		int num_squares_x = 28;
+		int num_squares_y = 32;
+		int board_width = num_squares_x * square_size_pixels;
+		int board_height = num_squares_y * square_size_pixels;
+		float scale = 4.0f;
+	};
+
+	Brain brain = {};
+	Game game = {};
+	Gui gui = {};
+};
+
+extern Settings settings;
+
+// Keeps the max_count most recently added barrels. Barrels never die, so every element is alive.
+class Barrel_buffer {
+public:
+	Barrel_buffer(uint32_t max_count, int width, int height) : max_count(max_count) {
+		elements.width = width;
+		elements.height = height;
+		elements.reserve(max_count);
+	}
+
+	void add_element(const Entity& element) {
+		if (elements.size() < max_count) {
+			elements.resize(elements.size() + 1);
+		}
+
+		elements.set(idx_cur, element);
+		elements.alive[idx_cur] = 1;
+		idx_cur = (idx_cur + 1) % max_count;
+	}
+
+	void clear() {
+		elements.resize(0);
+		idx_cur = 0;
+	}
+
+	// Slot of the most recently added barrel, with at least one added
+	uint32_t idx_newest() const {
+		return (idx_cur + max_count - 1) % max_count;
+	}
+
+	Entity_store elements = {};
+private:
+	uint32_t max_count = {};
+	uint32_t idx_cur = 0;
+};
+
+// Bookkeeping for the heuristics that end a generation early by killing agents that make no progress
+struct Kill_state {
+	std::vector<int> pos_previous_x = {};
+	std::vector<int> pos_previous_y = {};
+	int last_clear_physics_step = 0;
+	int last_clear_no_move = 0;
+};
+
+// Barrel bounds sorted by left edge, rebuilt every physics step, so a player only tests the few barrels
+//	that can reach its x. Which barrel is hit does not matter to physics(), only whether any is.
+struct Barrel_broad_phase {
+	struct Bounds {
+		int x_min = {};
+		int x_max = {};
+		int y_min = {};
+		int y_max = {};
+	};
+
+	void build(const Entity_store& barrels);
+	// Same test as a loop over every barrel with inclusive bounds
+	bool overlaps(int x, int y) const;
+
+	std::vector<Bounds> bounds = {};
+	int max_width = 0;
+};
+
+// How a genome's scores over several episodes become its fitness
+enum class Fitness_reduction {
+	Mean,
+	Min,
+	Quantile
+};
+
+struct Evaluation_settings {
+	// Episodes per generation, each with its own barrels. With one, the population plays in the Sim_state itself.
+	uint32_t num_episodes = 1;
+	Fitness_reduction reduction = Fitness_reduction::Mean;
+	// For Fitness_reduction::Quantile, in [0, 1]. Takes the lower of two neighbouring scores.
+	float quantile = 0.5f;
+	// Of the weights the networks are evaluated with. The population itself evolves in fp32.
+	Weight_precision weight_precision = Weight_precision::Fp32;
+	// When above 0, every episode is played in blocks of this many agents, one block per task on the
+	//	thread pool, with each block's weights packed from the population just before it plays. Only the
+	//	blocks being played are in memory, sized to stay in L2/L3, rather than the whole population. With a
+	//	single episode and no fixed seeds the blocks play the generation's barrels and carry the kill state
+	//	over like the Sim_state itself, so the run is the same as without blocks.
+	uint32_t agents_per_block = 0;
+	// Play every generation on the same barrels, drawn once from the run seed, instead of new ones each
+	//	generation. Always runs in episodes, even just one.
+	bool fixed_seeds = false;
+	// With fixed_seeds: genomes already evaluated last generation, and copies of a genome playing this
+	//	generation, sit out and take the known fitness. Do not change the other settings while caching.
+	bool cache_fitness = true;
+};
+
+// Whether run_generation plays the population in episodes rather than in the Sim_state itself
+bool uses_episodes(const Evaluation_settings& evaluation);
+
+class Replay_recorder;
+
+// Streams of a Sim_state seed
+constexpr uint32_t random_stream_genetic_algorithm = 0;
+constexpr uint32_t random_stream_barrels = 1;
+constexpr uint32_t random_stream_fixed_barrels = 2;
+// Evaluation_settings::agents_per_block that keeps a block's fp32 weights and state within a typical L2
+constexpr uint32_t default_agents_per_block = 1024;
+
+// Everything that evolves one population: its agents, barrels and brains. Separate Sim_states share
+//	nothing but the read-only Level, so they can be stepped on different threads.
+struct Sim_state {
+	Player_store players = {};
+	Barrel_buffer barrel_buffer = Barrel_buffer(50, barrel_width, barrel_height);
+	Barrel_broad_phase barrel_broad_phase = {};
+	Kill_state kill_state = {};
+	int num_physics_steps = 0;
+	int generation = 1;
+	std::unique_ptr<Genetic_algorithm> genetic_algorithm = nullptr;
+	Random barrel_random = {};
+	// Barrel seed of every generation with Evaluation_settings::fixed_seeds
+	uint64_t fixed_barrel_seed = 0;
+	// Null when stepping agents serially on the calling thread
+	Thread_pool* thread_pool = nullptr;
+	// One network per worker, since forward() writes to scratch buffers owned by the network
+	std::vector<Neural_net> neural_nets = {};
+	// Population weights in the interleaved layout used by Neural_net::forward_batch
+	Batch_weights batch_weights = {};
+	// When set, the networks play these instead of batch_weights. Episodes read their parent's this way
+	//	rather than each holding a copy.
+	const Batch_weights* shared_batch_weights = nullptr;
+	// Sensor readings for all agents, batch_inputs[idx_input * num_agents + idx_agent]. Only living
+	//	agents' readings and actions are updated.
+	std::vector<float> batch_inputs = {};
+	std::vector<uint32_t> batch_actions = {};
+	// Once half the agents are dead, choose_actions runs the networks of the survivors packed into
+	//	consecutive lanes: packed_agents[idx_lane] is the agent in each lane. Repacked whenever half of
+	//	those have died, empty while every agent has its own lane.
+	std::vector<uint32_t> packed_agents = {};
+	Batch_weights packed_weights = {};
+	std::vector<float> packed_inputs = {};
+	std::vector<uint32_t> packed_actions = {};
+	float best_score = 0.0f;
+	float best_score_overall = 0.0f;
+	int best_level = 0;
+	int best_level_overall = 0;
+	// Only the first player is alive and it is steered from the keyboard
+	bool is_human = false;
+	// Print per-generation progress to std::cout
+	bool verbose = true;
+	Evaluation_settings evaluation = {};
+	// With several episodes: one serially stepped Sim_state each, playing batch_weights through
+	//	shared_batch_weights. With
+	//	Evaluation_settings::agents_per_block one per worker instead, playing one block at a time.
+	std::vector<Sim_state> episodes = {};
+	// With several episodes: per episode and agent, [idx_episode * num_agents + idx_agent]
+	std::vector<float> episode_score_table = {};
+	std::vector<int> episode_level_table = {};
+	// With several episodes: reduced scores per agent and the best level reached in any episode
+	std::vector<float> episode_fitness = {};
+	int episode_best_level = 0;
+	std::vector<float> episode_scores = {};
+	// With Evaluation_settings::cache_fitness: per agent its genome's cache key, and the agent whose
+	//	result it takes. That is the agent itself if it plays, or fitness_source_cached.
+	Fitness_cache fitness_cache = {};
+	std::vector<uint64_t> genome_keys = {};
+	std::vector<uint32_t> fitness_source = {};
+	// Best level per agent over the episodes
+	std::vector<int> episode_levels = {};
+	uint32_t num_fitness_cached = 0;
+	uint32_t num_fitness_copied = 0;
+};
+
+constexpr uint32_t fitness_source_cached = std::numeric_limits<uint32_t>::max();
+
+// Creates the population, networks and random streams of a Sim_state from seed. thread_pool may be null.
+void init_sim_state(Sim_state& sim, uint64_t seed, Thread_pool* thread_pool, bool is_human = false);
+// Only the players, kill state and barrels of a Sim_state, for one whose actions come from outside such as
+//	a Vector_env env: no population, networks or batch weights. init_sim_state does this too.
+void init_env_state(Sim_state& sim, uint64_t seed, bool is_human = false);
+std::vector<Line_segment> generate_level(int num_squares_x);
+// Must be called whenever sim.genetic_algorithm->population or sim.evaluation.weight_precision changes
+void pack_population_weights(Sim_state& sim);
+void physics(Sim_state& sim, const Level& level);
+void jump(Player_store& players, uint32_t idx_player);
+void move_left(Player_store& players, uint32_t idx_player);
+void move_right(Player_store& players, uint32_t idx_player);
+void brain_update(Sim_state& sim);
+// A barrel at the spawn point, spawned every barrel_spawn_interval steps
+Entity new_barrel(bool rolling_right);
+void spawn_barrel(Sim_state& sim);
+void game_logics(Sim_state& sim);
+void init_players(Player_store& players, uint32_t num_agents, bool is_human, int player_width, int player_height);
+void init_kill_state(Kill_state& kill_state, const Player_store& players);
+void kill_agents(Sim_state& sim);
+// Living agents as of the last end_step
+int count_alive(const Player_store& players);
+// A step is begin_step, then picking an Action per agent from sim.batch_inputs, then end_step. The
+//	windowed game, the headless trainer and Vector_env all step through these.
+//	begin_step clears v_x, spawns barrels and writes this step's sensor readings to sim.batch_inputs.
+void begin_step(Sim_state& sim, const Level& level);
+// sim.batch_actions from each agent's network, after begin_step
+void choose_actions(Sim_state& sim);
+// Applies actions[idx_agent] (none if empty, when the players were steered directly), then runs physics
+//	and, unless is_human, the kill heuristics. Returns false once every agent is dead.
+bool end_step(Sim_state& sim, const Level& level, std::span<const uint32_t> actions);
+// One machine-controlled step as fast as possible. Returns false once every agent is dead.
+bool step(Sim_state& sim, const Level& level);
+// Plays the current generation until every agent is dead: in sim itself, or with several episodes, fixed
+//	seeds or blocks in evaluation, in episodes in parallel on the thread pool. Leaves the longest episode's length in
+//	num_physics_steps and returns the number of steps taken over all episodes. recorder, if not null,
+//	records a single-episode generation.
+int64_t run_generation(Sim_state& sim, const Level& level, Replay_recorder* recorder = nullptr);
+// Evolves the population from this generation's scores and resets the agents and barrels
+void next_generation(Sim_state& sim);
@@ -0,0 +1,133 @@
+#include <algorithm>
+
+#include <thread_pool.h>
+
+Thread_pool::Thread_pool(uint32_t num_threads) {
+	for (uint32_t idx_queue = 0; idx_queue < num_threads + 1; idx_queue++) {
+		work_queues.push_back(std::make_unique<Work_queue>());
+	}
+
+	for (uint32_t idx_thread = 0; idx_thread < num_threads; idx_thread++) {
+		threads.emplace_back(&Thread_pool::worker_loop, this, idx_thread + 1);
+	}
+}
+
+Thread_pool::~Thread_pool() {
+	{
+		auto lock = std::scoped_lock(mutex);
+		stop = true;
+	}
+
+	cv_work.notify_all();
+
+	for (auto& thread : threads) {
+		thread.join();
+	}
+}
+
+uint32_t Thread_pool::num_workers() const {
+	return static_cast<uint32_t>(work_queues.size());
+}
+
+void Thread_pool::parallel_for(uint32_t count, uint32_t chunk_size, const Range_function& fn) {
+	if (count == 0) {
+		return;
+	}
+
+	chunk_size = std::max(chunk_size, 1u);
+
+	auto num_ranges = (count + chunk_size - 1) / chunk_size;
+
+	if (threads.empty() || num_ranges == 1) {
+		fn(0, count, 0);
+		return;
+	}
+
+	cur_function = &fn;
+	num_ranges_remaining = num_ranges;
+
+	for (auto& work_queue : work_queues) {
+		auto lock = std::scoped_lock(work_queue->mutex);
+		work_queue->ranges.clear();
+		work_queue->idx_front = 0;
+	}
+
+	for (uint32_t idx_range = 0; idx_range < num_ranges; idx_range++) {
+		auto& work_queue = *work_queues[idx_range % work_queues.size()];
+		auto idx_begin = idx_range * chunk_size;
+		auto idx_end = std::min(idx_begin + chunk_size, count);
+		auto lock = std::scoped_lock(work_queue.mutex);
+		work_queue.ranges.push_back({ idx_begin, idx_end });
+	}
+
+	{
+		auto lock = std::scoped_lock(mutex);
+		epoch++;
+	}
+
+	cv_work.notify_all();
+	run_ranges(0);
+
+	auto lock = std::unique_lock(mutex);
+	cv_done.wait(lock, [this] { return num_ranges_remaining == 0; });
+	cur_function = nullptr;
+}
+
+void Thread_pool::worker_loop(uint32_t idx_worker) {
+	auto seen_epoch = uint64_t{};
+
+	while (true) {
+		{
+			auto lock = std::unique_lock(mutex);
+			cv_work.wait(lock, [this, &seen_epoch] { return stop || (epoch != seen_epoch); });
+
+			if (stop) {
+				return;
+			}
+
+			seen_epoch = epoch;
+		}
+
+		run_ranges(idx_worker);
+	}
+}
+
+bool Thread_pool::pop_range(uint32_t idx_worker, Range& range) {
+	// Own queue from the front, so neighbouring ranges stay on the same worker
+	{
+		auto& work_queue = *work_queues[idx_worker];
+		auto lock = std::scoped_lock(work_queue.mutex);
+
+		if (work_queue.idx_front < work_queue.ranges.size()) {
+			range = work_queue.ranges[work_queue.idx_front++];
+			return true;
+		}
+	}
+
+	// Steal from the back of the others
+	for (size_t idx_offset = 1; idx_offset < work_queues.size(); idx_offset++) {
+		auto& work_queue = *work_queues[(idx_worker + idx_offset) % work_queues.size()];
+		auto lock = std::scoped_lock(work_queue.mutex);
+
+		if (work_queue.idx_front < work_queue.ranges.size()) {
+			range = work_queue.ranges.back();
+			work_queue.ranges.pop_back();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void Thread_pool::run_ranges(uint32_t idx_worker) {
+	auto range = Range();
+
+	while (pop_range(idx_worker, range)) {
+		(*cur_function)(range.idx_begin, range.idx_end, idx_worker);
+
+		if (--num_ranges_remaining == 0) {
+			auto lock = std::scoped_lock(mutex);
+			cv_done.notify_one();
+		}
+	}
+}
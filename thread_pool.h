@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Persistent pool of worker threads. Work is split into index ranges that are dealt out to per-worker
+//	queues; a worker that runs out of ranges steals from the back of the other queues.
+//	The calling thread takes part in the work as worker 0, so num_workers() is num_threads + 1.
+class Thread_pool {
+public:
+	// Non-owning reference to a callable taking idx_begin, idx_end, idx_worker. Unlike std::function it never
+	//	allocates, so handing out work does not either. The callable must outlive the call it is passed to.
+	class Range_function {
+	public:
+		template <typename Function>
+			requires (!std::is_same_v<std::remove_cvref_t<Function>, Range_function>)
+		Range_function(const Function& function) : object(&function), call([](const void* object, uint32_t idx_begin, uint32_t idx_end, uint32_t idx_worker) {
+			(*static_cast<const Function*>(object))(idx_begin, idx_end, idx_worker);
+			}) {
+		}
+
+		void operator()(uint32_t idx_begin, uint32_t idx_end, uint32_t idx_worker) const {
+			call(object, idx_begin, idx_end, idx_worker);
+		}
+	private:
+		const void* object = nullptr;
+		void (*call)(const void*, uint32_t, uint32_t, uint32_t) = nullptr;
+	};
+
+	Thread_pool(uint32_t num_threads);
+	~Thread_pool();
+	uint32_t num_workers() const;
+	// Blocks until fn has been called for every chunk of [0, count)
+	void parallel_for(uint32_t count, uint32_t chunk_size, const Range_function& fn);
+private:
+	struct Range {
+		uint32_t idx_begin = {};
+		uint32_t idx_end = {};
+	};
+
+	// Ranges [idx_front, ranges.size()) are left. Cleared at the start of every parallel_for, so after the
+	//	first few calls the vector has all the capacity it needs.
+	struct Work_queue {
+		std::mutex mutex = {};
+		std::vector<Range> ranges = {};
+		size_t idx_front = 0;
+	};
+
+	void worker_loop(uint32_t idx_worker);
+	bool pop_range(uint32_t idx_worker, Range& range);
+	void run_ranges(uint32_t idx_worker);
+
+	std::vector<std::thread> threads = {};
+	std::vector<std::unique_ptr<Work_queue>> work_queues = {};
+	const Range_function* cur_function = nullptr;
+	std::atomic<uint32_t> num_ranges_remaining = 0;
+	std::mutex mutex = {};
+	std::condition_variable cv_work = {};
+	std::condition_variable cv_done = {};
+	uint64_t epoch = 0;
+	bool stop = false;
+};
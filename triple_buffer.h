@@ -0,0 +1,40 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Hands the latest value from one producer thread to one consumer thread without locks or waiting. Each
+//	side owns one slot and the third is swapped between them, so the producer never overwrites what the
+//	consumer reads and the consumer always gets the most recently published value, skipping older ones.
+template <typename T>
+class Triple_buffer {
+public:
+	// Producer: the slot to fill before the next publish. Holds whatever the producer wrote to it two publishes ago.
+	T& write_slot() {
+		return slots[idx_write];
+	}
+
+	// Producer: makes the write slot the newest value
+	void publish() {
+		idx_write = idx_shared.exchange(idx_write | fresh_bit, std::memory_order_acq_rel) & index_mask;
+	}
+
+	// Consumer: the newest published value. Stays valid and unchanged until the next call.
+	const T& read() {
+		if (idx_shared.load(std::memory_order_relaxed) & fresh_bit) {
+			idx_read = idx_shared.exchange(idx_read, std::memory_order_acq_rel) & index_mask;
+		}
+
+		return slots[idx_read];
+	}
+private:
+	static constexpr uint8_t index_mask = 3;
+	// Set while the shared slot holds a value the consumer has not taken yet
+	static constexpr uint8_t fresh_bit = 4;
+
+	std::array<T, 3> slots = {};
+	alignas(64) std::atomic<uint8_t> idx_shared = 1;
+	alignas(64) uint8_t idx_write = 0;
+	alignas(64) uint8_t idx_read = 2;
+};
@@ -0,0 +1,86 @@
+#include <algorithm>
+
+#include <vector_env.h>
+
+Vector_env::Vector_env(uint32_t num_envs, uint64_t seed, Thread_pool* thread_pool) : envs(num_envs), thread_pool(thread_pool) {
+	for (uint32_t idx_env = 0; idx_env < num_envs; idx_env++) {
+		auto& sim = envs[idx_env];
+
+		// Actions come from the caller, so an env has no population or networks. Envs step on pool threads
+		//	themselves, so their agents do not use the pool.
+		init_env_state(sim, Random::stream(seed, idx_env).next());
+		sim.verbose = false;
+	}
+
+	done.resize(num_envs);
+	scores.resize(static_cast<size_t>(num_envs) * num_agents());
+}
+
+uint32_t Vector_env::num_envs() const {
+	return static_cast<uint32_t>(envs.size());
+}
+
+uint32_t Vector_env::num_agents() const {
+	return static_cast<uint32_t>(settings.game.num_agents);
+}
+
+void Vector_env::reset(const Level& level) {
+	for (uint32_t idx_env = 0; idx_env < num_envs(); idx_env++) {
+		reset_env(idx_env);
+		begin_step(envs[idx_env], level);
+	}
+
+	std::fill(done.begin(), done.end(), uint8_t{ 0 });
+}
+
+std::span<const float> Vector_env::observations(uint32_t idx_env) const {
+	return envs[idx_env].batch_inputs;
+}
+
+void Vector_env::step(const Level& level, std::span<const uint32_t> actions) {
+	auto step_envs = [&](uint32_t idx_begin, uint32_t idx_end, uint32_t) {
+		for (auto idx_env = idx_begin; idx_env < idx_end; idx_env++) {
+			auto& sim = envs[idx_env];
+			auto any_alive = end_step(sim, level, actions.subspan(static_cast<size_t>(idx_env) * num_agents(), num_agents()));
+
+			done[idx_env] = any_alive ? 0 : 1;
+
+			if (!any_alive) {
+				std::copy(sim.players.score.begin(), sim.players.score.end(), scores.begin() + static_cast<size_t>(idx_env) * num_agents());
+				reset_env(idx_env);
+			}
+
+			begin_step(sim, level);
+		}
+		};
+
+	if (thread_pool) {
+		thread_pool->parallel_for(num_envs(), 1, step_envs);
+	}
+	else {
+		step_envs(0, num_envs(), 0);
+	}
+}
+
+std::span<const uint8_t> Vector_env::episode_done() const {
+	return done;
+}
+
+std::span<const int> Vector_env::episode_scores(uint32_t idx_env) const {
+	return std::span<const int>(scores).subspan(static_cast<size_t>(idx_env) * num_agents(), num_agents());
+}
+
+Sim_state& Vector_env::env(uint32_t idx_env) {
+	return envs[idx_env];
+}
+
+void Vector_env::reset_env(uint32_t idx_env) {
+	auto& sim = envs[idx_env];
+
+	init_players(sim.players, num_agents(), false, player_width, player_height);
+	init_kill_state(sim.kill_state, sim.players);
+	sim.kill_state.last_clear_physics_step = 0;
+	sim.kill_state.last_clear_no_move = 0;
+	sim.barrel_buffer.clear();
+	sim.num_physics_steps = 0;
+}
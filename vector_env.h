@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <simulation.h>
+
+// Many independent games stepped together, in the style of a gym vector env: read observations, pick an
+//	Action per agent outside, step them all in one call. Every env is a Sim_state with
+//	settings.game.num_agents agents and its own barrel stream. Envs are spread over the thread pool, with
+//	each env's agents stepped serially. After construction and the first few steps, nothing allocates.
+class Vector_env {
+public:
+	// thread_pool may be null
+	Vector_env(uint32_t num_envs, uint64_t seed, Thread_pool* thread_pool);
+	uint32_t num_envs() const;
+	uint32_t num_agents() const;
+	// Starts a new episode in every env and observes it
+	void reset(const Level& level);
+	// Observations for the coming step, observations(idx_env)[idx_input * num_agents() + idx_agent]
+	std::span<const float> observations(uint32_t idx_env) const;
+	// Applies actions[idx_env * num_agents() + idx_agent] and observes the next step. An env whose agents
+	//	are all dead has its scores copied to episode_scores, is flagged in episode_done and starts over.
+	void step(const Level& level, std::span<const uint32_t> actions);
+	// 1 for every env that finished an episode in the last step
+	std::span<const uint8_t> episode_done() const;
+	// Scores of the agents in the last finished episode of an env
+	std::span<const int> episode_scores(uint32_t idx_env) const;
+	Sim_state& env(uint32_t idx_env);
+private:
+	void reset_env(uint32_t idx_env);
+
+	std::vector<Sim_state> envs = {};
+	Thread_pool* thread_pool = nullptr;
+	std::vector<uint8_t> done = {};
+	std::vector<int> scores = {};
+};